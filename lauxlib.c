@@ -700,6 +700,164 @@ static int skipcomment (LoadF *lf, int *cp) {
 }
 
 
+/*
+** Compiled-chunk cache: when the environment variable named by
+** LUA_CACHEDIR_VAR is set, 'luaL_loadfilex' keeps the compiled form of
+** each text chunk it loads in that directory and reuses it later,
+** skipping the parser. Entries are named by a hash of the chunk name,
+** the text (as seen by the parser) and the build configuration, so a
+** changed file never finds a stale entry. New entries are written to
+** a private temporary file and then renamed over their final name, so
+** concurrent writers never expose partial files. As entries are
+** binary chunks, the cache is only used when 'mode' accepts both
+** text and binary chunks. (Writing needs
+** 'mkstemp', so without LUA_USE_POSIX the cache is only read.)
+*/
+#if !defined(LUA_CACHEDIR_VAR)
+#define LUA_CACHEDIR_VAR	"LUA_CACHEDIR"
+#endif
+
+
+/* configuration that must match for a compiled chunk to be reused */
+#define CACHECONFIG	LUA_RELEASE "|" LUA_INTEGER_FMT "|" LUA_NUMBER_FMT
+
+
+/* FNV-1a parameters for the size of 'lua_Unsigned' */
+#if ((LUA_MAXINTEGER >> 31) >> 31) >= 1	/* 64 bits? */
+#define FNVBASIS	((lua_Unsigned)0xcbf29ce484222325)
+#define FNVPRIME	((lua_Unsigned)0x100000001b3)
+#else
+#define FNVBASIS	((lua_Unsigned)2166136261u)
+#define FNVPRIME	((lua_Unsigned)16777619u)
+#endif
+
+
+static lua_Unsigned hashbytes (lua_Unsigned h, const char *s, size_t l) {
+  for (; l > 0; l--)  /* FNV-1a */
+    h = (h ^ (unsigned char)*s++) * FNVPRIME;
+  return h;
+}
+
+
+/*
+** Push the name of the cache entry for text 's' (of length 'l') loaded
+** with the given chunk name.
+*/
+static const char *pushcachename (lua_State *L, const char *dir,
+                                  const char *chunkname,
+                                  const char *s, size_t l) {
+  char buff[4 * sizeof(lua_Unsigned) + 2];
+  lua_Unsigned h = FNVBASIS;
+  h = hashbytes(h, CACHECONFIG, sizeof(CACHECONFIG));
+  h = hashbytes(h, chunkname, strlen(chunkname) + 1);
+  h = hashbytes(h, s, l);
+  l_sprintf(buff, sizeof(buff), "%" LUA_INTEGER_FRMLEN "x", (LUAI_UACINT)h);
+  return lua_pushfstring(L, "%s" LUA_DIRSEP "%s-%I.luac", dir, buff,
+                            (lua_Integer)l);
+}
+
+
+/*
+** Try to load the cache entry 'cname'. Returns true (with the function
+** on the stack) on success; any failure (no entry, corrupted entry)
+** just leaves the stack unchanged.
+*/
+static int loadcached (lua_State *L, const char *cname,
+                                     const char *chunkname) {
+  LoadF lf;
+  int status;
+  lf.f = fopen(cname, "rb");
+  if (lf.f == NULL) return 0;
+  lf.n = 0;
+  status = lua_load(L, getF, &lf, chunkname, "b");
+  if (ferror(lf.f) && status == LUA_OK)
+    status = LUA_ERRFILE;
+  fclose(lf.f);
+  if (status != LUA_OK) {
+    lua_pop(L, 1);  /* remove error message (or function) */
+    return 0;
+  }
+  return 1;
+}
+
+
+#if defined(LUA_USE_POSIX)
+
+#include <unistd.h>
+
+static int writer (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;
+  return (fwrite(b, size, 1, (FILE *)f) != 1) && (size != 0);
+}
+
+
+/*
+** Store the function on the top of the stack in the cache entry
+** 'cname'. Errors are ignored (the entry is simply not created).
+*/
+static void storecached (lua_State *L, const char *cname) {
+  /* 'mkstemp' needs a writable template; strings are not */
+  char *tmp = (char *)lua_newuserdata(L, strlen(cname) + sizeof(".XXXXXX"));
+  int fd;
+  strcpy(tmp, cname);
+  strcat(tmp, ".XXXXXX");
+  fd = mkstemp(tmp);
+  if (fd != -1) {
+    FILE *f = fdopen(fd, "wb");
+    int ok;
+    lua_pushvalue(L, -2);  /* function to be dumped */
+    ok = (f != NULL && lua_dump(L, writer, f, 0) == 0);
+    lua_pop(L, 1);  /* remove function copy */
+    if (f == NULL) close(fd);
+    else if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, cname) != 0)
+      remove(tmp);
+  }
+  lua_pop(L, 1);  /* remove template */
+}
+
+#else
+
+#define storecached(L,cname)	((void)0)
+
+#endif
+
+
+/*
+** Load the rest of the text file in 'lf' through the cache in 'dir'.
+** Leaves the function or an error message on the stack, like
+** 'lua_load'.
+*/
+static int loadthroughcache (lua_State *L, LoadF *lf, const char *dir,
+                                           const char *mode) {
+  luaL_Buffer b;
+  size_t l, n;
+  const char *s, *cname;
+  const char *chunkname = lua_tostring(L, -1);
+  int status;
+  luaL_buffinit(L, &b);
+  luaL_addlstring(&b, lf->buff, lf->n);  /* pre-read characters */
+  do {
+    char *p = luaL_prepbuffer(&b);
+    n = fread(p, 1, LUAL_BUFFERSIZE, lf->f);
+    luaL_addsize(&b, n);
+  } while (n == LUAL_BUFFERSIZE);
+  luaL_pushresult(&b);
+  s = lua_tolstring(L, -1, &l);
+  cname = pushcachename(L, dir, chunkname, s, l);
+  if (loadcached(L, cname, chunkname))
+    status = LUA_OK;
+  else {
+    status = luaL_loadbufferx(L, s, l, chunkname, mode);
+    if (status == LUA_OK)
+      storecached(L, cname);
+  }
+  lua_replace(L, -3);  /* result replaces the text */
+  lua_pop(L, 1);  /* remove cache name */
+  return status;
+}
+
+
 /*
 把一个文件加载为 Lua 代码块。 这个函数使用 lua_load 加载文件中的数据。 
 代码块的名字被命名为 filename。 如果 filename 为 NULL， 它从标准输入加载。 
@@ -717,6 +875,7 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   LoadF lf;
   int status, readstatus;
   int c;
+  const char *cachedir;
   int fnameindex = lua_gettop(L) + 1;  	/* index of filename on the stack */
   if (filename == NULL) {
     lua_pushliteral(L, "=stdin");
@@ -737,8 +896,14 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   if (c != EOF)
     lf.buff[lf.n++] = c;  /* 'c' is the first character of the stream */
 
-  // 读取文件，读取器函数传入 getF()
-  status = lua_load(L, getF, &lf, lua_tostring(L, -1), mode);
+  if (filename && c != LUA_SIGNATURE[0] &&  /* text file? */
+      /* cached entries are binary chunks: mode must allow both kinds */
+      (mode == NULL || (strchr(mode, 't') != NULL &&
+                        strchr(mode, 'b') != NULL)) &&
+      (cachedir = getenv(LUA_CACHEDIR_VAR)) != NULL)
+    status = loadthroughcache(L, &lf, cachedir, mode);
+  else  /* 读取文件，读取器函数传入 getF() */
+    status = lua_load(L, getF, &lf, lua_tostring(L, -1), mode);
   readstatus = ferror(lf.f);
   if (filename) fclose(lf.f);  /* close file (even in case of errors) */
   if (readstatus) {
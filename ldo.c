@@ -185,6 +185,27 @@ static void correctstack (lua_State *L, TValue *oldstack) {
 #define ERRORSTACKSIZE	(LUAI_MAXSTACK + 200)
 
 
+/*
+** Stack size policy: a stack that overflows grows to LUAI_STACKGROW
+** times its size (or more, if needed). The collector shrinks a stack
+** only when it is larger than LUAI_STACKSHRINK times the part in use,
+** and then leaves it with room to grow LUAI_STACKGROW times that part.
+** The gap between both factors keeps a thread that keeps going deep
+** and back from reallocating its stack at every collection.
+*/
+#if !defined(LUAI_STACKGROW)
+#define LUAI_STACKGROW		2
+#endif
+
+#if !defined(LUAI_STACKSHRINK)
+#define LUAI_STACKSHRINK	3
+#endif
+
+#if LUAI_STACKGROW < 2 || LUAI_STACKSHRINK <= LUAI_STACKGROW
+#error "stack policy needs LUAI_STACKSHRINK > LUAI_STACKGROW >= 2"
+#endif
+
+
 void luaD_reallocstack (lua_State *L, int newsize) {
   TValue *oldstack = L->stack;
   int lim = L->stacksize;
@@ -205,8 +226,8 @@ void luaD_growstack (lua_State *L, int n) {
     luaD_throw(L, LUA_ERRERR);
   else {
     int needed = cast_int(L->top - L->stack) + n + EXTRA_STACK;
-    int newsize = 2 * size;
-    if (newsize > LUAI_MAXSTACK) newsize = LUAI_MAXSTACK;
+    int newsize = (size > LUAI_MAXSTACK / LUAI_STACKGROW)
+                  ? LUAI_MAXSTACK : LUAI_STACKGROW * size;
     if (newsize < needed) newsize = needed;
     if (newsize > LUAI_MAXSTACK) {  /* stack overflow? */
       luaD_reallocstack(L, ERRORSTACKSIZE);
@@ -231,18 +252,20 @@ static int stackinuse (lua_State *L) {
 
 void luaD_shrinkstack (lua_State *L) {
   int inuse = stackinuse(L);
-  int goodsize = inuse + (inuse / 8) + 2*EXTRA_STACK;
-  if (goodsize > LUAI_MAXSTACK)
-    goodsize = LUAI_MAXSTACK;  /* respect stack limit */
+  int max = (inuse > LUAI_MAXSTACK / LUAI_STACKSHRINK)
+            ? LUAI_MAXSTACK : LUAI_STACKSHRINK * inuse;
   if (L->stacksize > LUAI_MAXSTACK)  /* had been handling stack overflow? */
     luaE_freeCI(L);  /* free all CIs (list grew because of an error) */
   else
     luaE_shrinkCI(L);  /* shrink list */
   /* if thread is currently not handling a stack overflow and its
-     good size is smaller than current size, shrink its stack */
-  if (inuse <= (LUAI_MAXSTACK - EXTRA_STACK) &&
-      goodsize < L->stacksize)
-    luaD_reallocstack(L, goodsize);
+     size is larger than maximum "reasonable" size, shrink its stack */
+  if (inuse <= (LUAI_MAXSTACK - EXTRA_STACK) && L->stacksize > max) {
+    int goodsize = (inuse > (LUAI_MAXSTACK - 2*EXTRA_STACK) / LUAI_STACKGROW)
+                   ? LUAI_MAXSTACK : LUAI_STACKGROW * inuse + 2*EXTRA_STACK;
+    if (goodsize < L->stacksize)  /* really shrinking? */
+      luaD_reallocstack(L, goodsize);
+  }
   else  /* don't change stack */
     condmovestack(L,{},{});  /* (change only for debugging) */
 }
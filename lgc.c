@@ -1159,7 +1159,10 @@ void luaC_step (lua_State *L) {
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(g->gckind == KGC_NORMAL);
-  if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
+  if (isemergency) {
+    g->gckind = KGC_EMERGENCY;  /* set flag */
+    luaE_freepools(L);  /* release memory kept for new threads */
+  }
   if (keepinvariant(g)) {  /* black objects? */
     entersweep(L); /* sweep everything to turn them back to white */
   }
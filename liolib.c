@@ -386,6 +386,12 @@ static int io_lines (lua_State *L) {
 #endif
 
 
+/* maximum number of slots preallocated by 'readnumbers' */
+#if !defined (L_NUMPRESIZE)
+#define L_NUMPRESIZE	65536
+#endif
+
+
 /* auxiliary structure used by 'read_number' */
 typedef struct {
   FILE *f;  /* file being read */
@@ -471,6 +477,12 @@ static int read_number (lua_State *L, FILE *f) {
 }
 
 
+/* size of the first piece read by 'read_line' */
+#if !defined(L_FIRSTPIECE)
+#define L_FIRSTPIECE	128
+#endif
+
+
 static int test_eof (lua_State *L, FILE *f) {
   int c = getc(f);
   ungetc(c, f);  /* no-op when c == EOF */
@@ -479,18 +491,41 @@ static int test_eof (lua_State *L, FILE *f) {
 }
 
 
+/*
+** Read a line in pieces with 'fgets', which scans the stream buffer in
+** blocks instead of one char at a time. 'fgets' does not tell how many
+** chars it read and a line may contain zeros, so each piece of the
+** buffer is first filled with newlines: then, its first newline either
+** ends the line (and is followed by the '\0' added by 'fgets') or is
+** a filler right after that '\0' (when the piece ended without a
+** newline, by end of file or error). The first piece is small, as
+** most lines are short and the filling costs as much as the reading.
+*/
 static int read_line (lua_State *L, FILE *f, int chop) {
   luaL_Buffer b;
   int c = '\0';
+  size_t piece = L_FIRSTPIECE;  /* size of next piece */
   luaL_buffinit(L, &b);
   while (c != EOF && c != '\n') {  /* repeat until end of line */
-    char *buff = luaL_prepbuffer(&b);  /* preallocate buffer */
-    int i = 0;
-    l_lockfile(f);  /* no memory errors can happen inside the lock */
-    while (i < LUAL_BUFFERSIZE && (c = l_getc(f)) != EOF && c != '\n')
-      buff[i++] = c;
-    l_unlockfile(f);
+    char *buff = luaL_prepbuffsize(&b, piece);  /* preallocate buffer */
+    const char *nl;
+    size_t i;
+    memset(buff, '\n', piece);
+    if (fgets(buff, (int)piece, f) == NULL)
+      break;  /* end of file (or error) and nothing read */
+    nl = (const char *)memchr(buff, '\n', piece);
+    if (nl == NULL)  /* piece filled the buffer without a newline? */
+      i = piece - 1;  /* keep reading the line */
+    else if (nl + 1 < buff + piece && nl[1] == '\0') {
+      i = nl - buff;  /* line ends here */
+      c = '\n';
+    }
+    else {  /* filler after the '\0': stream ended before a newline */
+      i = (nl - buff) - 1;
+      c = EOF;
+    }
     luaL_addsize(&b, i);
+    piece = LUAL_BUFFERSIZE;
   }
   if (!chop && c == '\n')  /* want a newline and have one? */
     luaL_addchar(&b, c);  /* add ending newline to result */
@@ -586,6 +621,40 @@ static int f_read (lua_State *L) {
 }
 
 
+/*
+** file:readnumbers(n [, t]) reads up to 'n' numerals into t[1..k]
+** (a new table if 't' is absent) and returns 't' and 'k'. Reading
+** stops at the end of the file or at the first invalid numeral, as
+** for "n" in 'read'.
+*/
+static int f_readnumbers (lua_State *L) {
+  FILE *f = tofile(L);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  lua_Integer k = 0;
+  luaL_argcheck(L, n >= 0, 2, "invalid count");
+  if (lua_isnoneornil(L, 3)) {
+    lua_settop(L, 2);
+    lua_createtable(L, (int)(n < L_NUMPRESIZE ? n : L_NUMPRESIZE), 0);
+  }
+  else {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_settop(L, 3);
+  }
+  clearerr(f);
+  while (k < n) {
+    if (!read_number(L, f)) {
+      lua_pop(L, 1);  /* remove nil "result" */
+      break;
+    }
+    lua_rawseti(L, 3, ++k);
+  }
+  if (ferror(f))
+    return luaL_fileresult(L, 0, NULL);
+  lua_pushinteger(L, k);
+  return 2;
+}
+
+
 static int io_readline (lua_State *L) {
   LStream *p = (LStream *)lua_touserdata(L, lua_upvalueindex(1));
   int i;
@@ -614,30 +683,119 @@ static int io_readline (lua_State *L) {
   }
 }
 
+/*
+** Iterator for 'file:chunks': reads the next block of the file into the
+** buffer kept as its third upvalue, so that all blocks reuse the same
+** memory, and returns it as a string (or nothing at the end of file).
+*/
+static int io_readchunk (lua_State *L) {
+  LStream *p = (LStream *)lua_touserdata(L, lua_upvalueindex(1));
+  size_t size = (size_t)lua_tointeger(L, lua_upvalueindex(2));
+  char *buff = (char *)lua_touserdata(L, lua_upvalueindex(3));
+  size_t nr;
+  if (isclosed(p))  /* file is already closed? */
+    return luaL_error(L, "file is already closed");
+  clearerr(p->f);
+  nr = fread(buff, sizeof(char), size, p->f);
+  if (ferror(p->f))
+    return luaL_error(L, "%s", strerror(errno));
+  if (nr == 0)  /* end of file? */
+    return 0;
+  lua_pushlstring(L, buff, nr);
+  return 1;
+}
+
+
+static int f_chunks (lua_State *L) {
+  lua_Integer size = luaL_optinteger(L, 2, LUAL_BUFFERSIZE);
+  tofile(L);  /* check that it's a valid file handle */
+  luaL_argcheck(L, 0 < size && (lua_Unsigned)size <= (size_t)~(size_t)0, 2,
+                   "invalid chunk size");
+  lua_settop(L, 1);  /* file is first upvalue */
+  lua_pushinteger(L, size);
+  lua_newuserdata(L, (size_t)size);  /* buffer for all chunks */
+  lua_pushcclosure(L, io_readchunk, 3);
+  return 1;
+}
+
 /* }====================================================== */
 
 
+/*
+** Arguments are gathered in a local batch and handed to stdio with one
+** 'fwrite' per batch, instead of one call per argument. Numbers are
+** formatted straight into the batch; strings too large for it are
+** written directly, after flushing what is pending.
+*/
+#if !defined(L_WRITEBATCH)
+#define L_WRITEBATCH	LUAL_BUFFERSIZE
+#endif
+
+/* enough space for any formatted number */
+#define L_MAXNUM2STR	50
+
+
+typedef struct WBatch {
+  FILE *f;
+  size_t n;  /* number of bytes pending in 'buff' */
+  int status;
+  char buff[L_WRITEBATCH];
+} WBatch;
+
+
+static void flushbatch (WBatch *wb) {
+  if (wb->n > 0) {
+    wb->status = wb->status &&
+                 (fwrite(wb->buff, sizeof(char), wb->n, wb->f) == wb->n);
+    wb->n = 0;
+  }
+}
+
+
+static void addtobatch (WBatch *wb, const char *s, size_t l) {
+  if (l > L_WRITEBATCH - wb->n) {  /* does not fit? */
+    flushbatch(wb);
+    if (l > L_WRITEBATCH / 2) {  /* large string? write it directly */
+      wb->status = wb->status && (fwrite(s, sizeof(char), l, wb->f) == l);
+      return;
+    }
+  }
+  memcpy(wb->buff + wb->n, s, l);
+  wb->n += l;
+}
+
+
 static int g_write (lua_State *L, FILE *f, int arg) {
   int nargs = lua_gettop(L) - arg;
-  int status = 1;
+  WBatch wb;
+  wb.f = f; wb.n = 0; wb.status = 1;
   for (; nargs--; arg++) {
     if (lua_type(L, arg) == LUA_TNUMBER) {
-      /* optimization: could be done exactly as for strings */
-      int len = lua_isinteger(L, arg)
-                ? fprintf(f, LUA_INTEGER_FMT,
-                             (LUAI_UACINT)lua_tointeger(L, arg))
-                : fprintf(f, LUA_NUMBER_FMT,
-                             (LUAI_UACNUMBER)lua_tonumber(L, arg));
-      status = status && (len > 0);
+      int len;
+      if (L_MAXNUM2STR > L_WRITEBATCH - wb.n)
+        flushbatch(&wb);
+      /* floats keep 'lua_number2str', which honors LUAI_NUMFFORMAT */
+      len = lua_isinteger(L, arg)
+            ? lua_integer2str(wb.buff + wb.n, L_MAXNUM2STR,
+                              lua_tointeger(L, arg))
+            : lua_number2str(wb.buff + wb.n, L_MAXNUM2STR,
+                             lua_tonumber(L, arg));
+      wb.status = wb.status && (len > 0);
+      if (len > 0) wb.n += len;
     }
     else {
       size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
-      status = status && (fwrite(s, sizeof(char), l, f) == l);
+      const char *s = lua_tolstring(L, arg, &l);
+      if (s == NULL) {  /* not a string? */
+        flushbatch(&wb);  /* keep what came before the bad argument */
+        luaL_checklstring(L, arg, &l);  /* raise the error */
+      }
+      addtobatch(&wb, s, l);
     }
   }
-  if (status) return 1;  /* file handle already on stack top */
-  else return luaL_fileresult(L, status, NULL);
+  flushbatch(&wb);
+  if (wb.status) return 1;  /* file handle already on stack top */
+  else return luaL_fileresult(L, wb.status, NULL);
 }
 
 
@@ -717,10 +875,12 @@ static const luaL_Reg iolib[] = {
 ** methods for file handles
 */
 static const luaL_Reg flib[] = {
+  {"chunks", f_chunks},
   {"close", f_close},
   {"flush", f_flush},
   {"lines", f_lines},
   {"read", f_read},
+  {"readnumbers", f_readnumbers},
   {"seek", f_seek},
   {"setvbuf", f_setvbuf},
   {"write", f_write},
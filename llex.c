@@ -101,7 +101,9 @@ const char *luaX_token2str (LexState *ls, int token) {
 
 static const char *txtToken (LexState *ls, int token) {
   switch (token) {
-    case TK_NAME: case TK_STRING:
+    case TK_NAME:  /* may not have gone through 'ls->buff' */
+      return luaO_pushfstring(ls->L, "'%s'", getstr(ls->t.seminfo.ts));
+    case TK_STRING:
     case TK_FLT: case TK_INT:
       save(ls, '\0');
       return luaO_pushfstring(ls->L, "'%s'", luaZ_buffer(ls->buff));
@@ -437,6 +439,67 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
                                    luaZ_bufflen(ls->buff) - 2);
 }
 
+/*
+** The lexer may also scan the current block of the input stream
+** directly, instead of calling 'next' for each character: as every
+** character comes from 'zgetc', 'ls->current' (if not EOZ) is always
+** the character just before 'z->p', and 'z->p' .. 'z->p + z->n' are
+** the characters that follow it in the block.
+*/
+#define blockstart(ls)	((ls)->z->p)
+#define blockend(ls)	((ls)->z->p + (ls)->z->n)
+
+
+/*
+** Advance the input stream to position 'p' of its current block (or to
+** its end) and read the character there into 'ls->current'.
+*/
+static void skipto (LexState *ls, const char *p) {
+  ZIO *z = ls->z;
+  z->n -= p - z->p;
+  z->p = p;
+  next(ls);
+}
+
+
+/* skip the rest of a short comment */
+static void skip_line (LexState *ls) {
+  while (!currIsNewline(ls) && ls->current != EOZ) {
+    const char *p = blockstart(ls);
+    const char *e = blockend(ls);
+    while (p < e && *p != '\n' && *p != '\r')
+      p++;
+    skipto(ls, p);
+  }
+}
+
+
+/*
+** Read an identifier or reserved word. When the whole name is inside
+** the current block, it is created straight from there, without
+** copying it to 'ls->buff'.
+*/
+static TString *read_name (LexState *ls) {
+  const char *p = blockstart(ls);
+  const char *e = blockend(ls);
+  while (p < e && lislalnum(cast_uchar(*p)))
+    p++;
+  if (p < e) {  /* name ends inside the block? */
+    const char *start = blockstart(ls) - 1;  /* 'ls->current' */
+    TString *ts = luaX_newstring(ls, start, p - start);
+    skipto(ls, p);
+    return ts;
+  }
+  else {  /* name may continue in next block; go the slow way */
+    do {
+      save_and_next(ls);
+    } while (lislalnum(ls->current));  // 读取字符串
+    return luaX_newstring(ls, luaZ_buffer(ls->buff),
+                              luaZ_bufflen(ls->buff));
+  }
+}
+
+
 /*
 读取字符，解析成 token
 */
@@ -449,7 +512,11 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         break;
       }
       case ' ': case '\f': case '\t': case '\v': {  /* spaces */
-        next(ls);				// 跳过空白符
+        const char *p = blockstart(ls);
+        const char *e = blockend(ls);
+        while (p < e && (*p == ' ' || *p == '\t'))
+          p++;
+        skipto(ls, p);				// 跳过空白符
         break;
       }
       case '-': {  				/* '-' or '--' (comment) */
@@ -467,8 +534,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
           }
         }
         /* 短注释。else short comment */
-        while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);  /* skip until end of line (or end of file) */
+        skip_line(ls);  /* skip until end of line (or end of file) */
         break;
       }
       case '[': {  /* long string or simply '[' */
@@ -537,12 +603,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
       }
       default: {
         if (lislalpha(ls->current)) {  		/* identifier or reserved word? */
-          TString *ts;
-          do {
-            save_and_next(ls);
-          } while (lislalnum(ls->current));  // 读取字符串
-          ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
-                                  luaZ_bufflen(ls->buff));
+          TString *ts = read_name(ls);
           seminfo->ts = ts; 	// 保存语义信息
           if (isreserved(ts))   /* reserved word? */
             return ts->extra - 1 + FIRST_RESERVED; // 返回关键字token序号
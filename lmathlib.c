@@ -10,6 +10,8 @@
 #include "lprefix.h"
 
 
+#include <float.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <math.h>
 
@@ -23,18 +25,6 @@
 #define PI	(l_mathop(3.141592653589793238462643383279502884))
 
 
-#if !defined(l_rand)		/* { */
-#if defined(LUA_USE_POSIX)
-#define l_rand()	random()
-#define l_srand(x)	srandom(x)
-#define L_RANDMAX	2147483647	/* (2^31 - 1), following POSIX */
-#else
-#define l_rand()	rand()
-#define l_srand(x)	srand(x)
-#define L_RANDMAX	RAND_MAX
-#endif
-#endif				/* } */
-
 static int math_abs (lua_State *L) {
   if (lua_isinteger(L, 1)) {   // 当前数据栈中索引位置1的数据是否为整型？
     lua_Integer n = lua_tointeger(L, 1);
@@ -238,22 +228,214 @@ static int math_max (lua_State *L) {
   return 1;
 }
 
+/*
+** {==================================================================
+** Pseudo-Random Number Generator
+** Each state has its own generator, kept in a userdata shared as an
+** upvalue by 'random', 'randomseed' and 'randomfill'. It is seeded
+** with a fixed value when the library is opened, so that a program
+** that does not call 'randomseed' always gets the same sequence.
+** ===================================================================
+*/
+
+/* type with (at least) 64 bits for the generator */
+#if !defined(LUA_RAND32) && ((ULONG_MAX >> 31) >> 31) >= 3
+typedef unsigned long Rand64;
+#define LUA_RAND64
+#elif !defined(LUA_RAND32) && defined(LLONG_MAX) && !defined(LUA_USE_C89)
+typedef unsigned long long Rand64;
+#define LUA_RAND64
+#endif
+
+
+#if defined(LUA_RAND64)		/* { */
+
+/*
+** Implementation of 'xoshiro256**', by David Blackman and Sebastiano
+** Vigna, on 64-bit values ('Rand64' values wider than 64 bits are
+** trimmed where it matters).
+*/
+
+typedef struct RanState {
+  Rand64 s[4];
+} RanState;
+
+
+#define trim64(x)	((x) & ((((Rand64)0xffffffffu) << 32) | 0xffffffffu))
+
+/* rotate left 'x' by 'n' bits */
+static Rand64 rotl (Rand64 x, int n) {
+  return (x << n) | (trim64(x) >> (64 - n));
+}
+
+static Rand64 nextrand (Rand64 *state) {
+  Rand64 res = rotl(state[1] * 5, 7) * 9;
+  Rand64 t = state[1] << 17;
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotl(state[3], 45);
+  return res;
+}
+
+
+/* number of random bits in a float ('FIGS' <= 64) */
+#define FIGS	((l_mathlim(MANT_DIG) <= 64) ? l_mathlim(MANT_DIG) : 64)
+
+/* 2^(-FIGS) */
+#define scaleFIG  \
+	(l_mathop(0.5) / (lua_Number)((Rand64)1 << (FIGS - 1)))
+
+/* a float in [0, 1) built from the higher 'FIGS' bits of 'x' */
+static lua_Number I2d (Rand64 x) {
+  return (lua_Number)(trim64(x) >> (64 - FIGS)) * scaleFIG;
+}
+
+
+static lua_Number randfloat (RanState *g) {
+  return I2d(nextrand(g->s));
+}
+
+
+static lua_Integer randfull (RanState *g) {
+  return (lua_Integer)(lua_Unsigned)nextrand(g->s);
+}
+
+
+/*
+** Random integer in [low, up], with 'low <= up'. The random value is
+** projected into the smallest interval [0, 2^b - 1] containing
+** 'up - low'; values outside [0, up - low] are discarded, so that all
+** results are equally likely.
+*/
+static lua_Integer randrange (RanState *g, lua_Integer low,
+                              lua_Integer up) {
+  lua_Unsigned n = (lua_Unsigned)up - (lua_Unsigned)low;
+  lua_Unsigned ran = (lua_Unsigned)nextrand(g->s);
+  if ((n & (n + 1)) != 0) {  /* 'n + 1' is not a power of 2? */
+    lua_Unsigned lim = n;
+    /* compute the smallest (2^b - 1) not smaller than 'n' */
+    lim |= (lim >> 1);
+    lim |= (lim >> 2);
+    lim |= (lim >> 4);
+    lim |= (lim >> 8);
+    lim |= (lim >> 16);
+#if (LUA_MAXINTEGER >> 30) > 1
+    lim |= (lim >> 32);  /* integer type has more than 32 bits */
+#endif
+    while ((ran &= lim) > n)  /* project 'ran' into [0, lim] */
+      ran = (lua_Unsigned)nextrand(g->s);  /* not inside [0, n]? Try again */
+  }
+  else
+    ran &= n;
+  return (lua_Integer)(ran + (lua_Unsigned)low);
+}
+
+
+static void setseed (RanState *g, lua_Integer n1, lua_Integer n2) {
+  int i;
+  g->s[0] = (Rand64)(lua_Unsigned)n1;  /* avoid a zero state */
+  g->s[1] = (Rand64)0xff;
+  g->s[2] = (Rand64)(lua_Unsigned)n2;
+  g->s[3] = 0;
+  for (i = 0; i < 16; i++)
+    nextrand(g->s);  /* discard initial values to "spread" seed */
+}
+
+/* the generator covers any interval of integers */
+#define fullrange(low,up)	1
+
+#else				/* }{ */
+
+/*
+** No 64-bit type available: fall back to the C library generator,
+** whose state is global and which gives only about 31 random bits.
+*/
+
+#if !defined(l_rand)		/* { */
+#if defined(LUA_USE_POSIX)
+#define l_rand()	random()
+#define l_srand(x)	srandom(x)
+#define L_RANDMAX	2147483647	/* (2^31 - 1), following POSIX */
+#else
+#define l_rand()	rand()
+#define l_srand(x)	srand(x)
+#define L_RANDMAX	RAND_MAX
+#endif
+#endif				/* } */
+
+typedef struct RanState {
+  int dummy;
+} RanState;
+
+
 /*
 ** This function uses 'double' (instead of 'lua_Number') to ensure that
 ** all bits from 'l_rand' can be represented, and that 'RANDMAX + 1.0'
 ** will keep full precision (ensuring that 'r' is always less than 1.0.)
 */
+static double randdouble (void) {
+  return (double)l_rand() * (1.0 / ((double)L_RANDMAX + 1.0));
+}
+
+static lua_Number randfloat (RanState *g) {
+  (void)g;
+  return (lua_Number)randdouble();
+}
+
+static lua_Integer randfull (RanState *g) {
+  lua_Unsigned r = (lua_Unsigned)l_rand();
+  (void)g;
+  r = (r << 16) ^ (lua_Unsigned)l_rand();
+  return (lua_Integer)((r << 16) ^ (lua_Unsigned)l_rand());
+}
+
+static lua_Integer randrange (RanState *g, lua_Integer low,
+                              lua_Integer up) {
+  double r = randdouble() * ((double)(up - low) + 1.0);
+  (void)g;
+  return (lua_Integer)r + low;
+}
+
+static void setseed (RanState *g, lua_Integer n1, lua_Integer n2) {
+  (void)g;
+  l_srand((unsigned int)(n1 ^ n2));
+  (void)l_rand(); /* discard first value to avoid undesirable correlations */
+}
+
+/* 'randrange' only works for intervals that fit in a lua_Integer */
+#define fullrange(low,up)	((low) >= 0 || (up) <= LUA_MAXINTEGER + (low))
+
+#endif				/* } */
+
+
+#define getrandstate(L)	((RanState *)lua_touserdata(L, lua_upvalueindex(1)))
+
+
+static void checkinterval (lua_State *L, lua_Integer low, lua_Integer up,
+                           int arg) {
+  luaL_argcheck(L, low <= up, arg, "interval is empty");
+  luaL_argcheck(L, fullrange(low, up), arg, "interval too large");
+}
+
+
 static int math_random (lua_State *L) {
   lua_Integer low, up;
-  double r = (double)l_rand() * (1.0 / ((double)L_RANDMAX + 1.0));
+  RanState *g = getrandstate(L);
   switch (lua_gettop(L)) {  /* check number of arguments */
     case 0: {  /* no arguments */
-      lua_pushnumber(L, (lua_Number)r);  /* Number between 0 and 1 */
+      lua_pushnumber(L, randfloat(g));  /* Number between 0 and 1 */
       return 1;
     }
     case 1: {  /* only upper limit */
       low = 1;
       up = luaL_checkinteger(L, 1);
+      if (up == 0) {  /* single 0 as argument? */
+        lua_pushinteger(L, randfull(g));  /* full random integer */
+        return 1;
+      }
       break;
     }
     case 2: {  /* lower and upper limits */
@@ -264,22 +446,73 @@ static int math_random (lua_State *L) {
     default: return luaL_error(L, "wrong number of arguments");
   }
   /* random integer in the interval [low, up] */
-  luaL_argcheck(L, low <= up, 1, "interval is empty");
-  luaL_argcheck(L, low >= 0 || up <= LUA_MAXINTEGER + low, 1,
-                   "interval too large");
-  r *= (double)(up - low) + 1.0;
-  lua_pushinteger(L, (lua_Integer)r + low);
+  checkinterval(L, low, up, 1);
+  lua_pushinteger(L, randrange(g, low, up));
   return 1;
 }
 
 
 static int math_randomseed (lua_State *L) {
-  l_srand((unsigned int)(lua_Integer)luaL_checknumber(L, 1));
-  (void)l_rand(); /* discard first value to avoid undesirable correlations */
+  lua_Integer n1 = lua_isinteger(L, 1) ? lua_tointeger(L, 1)
+                 : (lua_Integer)luaL_checknumber(L, 1);
+  lua_Integer n2 = luaL_optinteger(L, 2, 0);
+  setseed(getrandstate(L), n1, n2);
   return 0;
 }
 
 
+/*
+** randomfill(t, n [, low, up]) sets t[1..n] to random floats in [0, 1)
+** or, when the limits are given, to random integers in [low, up].
+** Returns 't'.
+*/
+static int math_randomfill (lua_State *L) {
+  RanState *g = getrandstate(L);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  lua_Integer i;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_argcheck(L, 0 <= n && n < INT_MAX, 2, "invalid count");
+  if (lua_isnoneornil(L, 3)) {
+    lua_settop(L, 1);
+    for (i = 1; i <= n; i++) {
+      lua_pushnumber(L, randfloat(g));
+      lua_rawseti(L, 1, i);
+    }
+  }
+  else {
+    lua_Integer low = luaL_checkinteger(L, 3);
+    lua_Integer up = luaL_checkinteger(L, 4);
+    checkinterval(L, low, up, 3);
+    lua_settop(L, 1);
+    for (i = 1; i <= n; i++) {
+      lua_pushinteger(L, randrange(g, low, up));
+      lua_rawseti(L, 1, i);
+    }
+  }
+  return 1;
+}
+
+
+static const luaL_Reg randfuncs[] = {
+  {"random", math_random},
+  {"randomseed", math_randomseed},
+  {"randomfill", math_randomfill},
+  {NULL, NULL}
+};
+
+
+/*
+** Register the random functions with a new generator as their upvalue
+*/
+static void setrandfunc (lua_State *L) {
+  RanState *g = (RanState *)lua_newuserdata(L, sizeof(RanState));
+  setseed(g, 0, 0);
+  luaL_setfuncs(L, randfuncs, 1);
+}
+
+/* }================================================================== */
+
+
 static int math_type (lua_State *L) {
   if (lua_type(L, 1) == LUA_TNUMBER) {
       if (lua_isinteger(L, 1))
@@ -366,8 +599,6 @@ static const luaL_Reg mathlib[] = {
   {"min",   math_min},
   {"modf",   math_modf},
   {"rad",   math_rad},
-  {"random",     math_random},
-  {"randomseed", math_randomseed},
   {"sin",   math_sin},
   {"sqrt",  math_sqrt},
   {"tan",   math_tan},
@@ -387,6 +618,9 @@ static const luaL_Reg mathlib[] = {
   {"huge", NULL},
   {"maxinteger", NULL},
   {"mininteger", NULL},
+  {"random", NULL},
+  {"randomseed", NULL},
+  {"randomfill", NULL},
   {NULL, NULL}
 };
 
@@ -404,6 +638,7 @@ LUAMOD_API int luaopen_math (lua_State *L) {
   lua_setfield(L, -2, "maxinteger");
   lua_pushinteger(L, LUA_MININTEGER);
   lua_setfield(L, -2, "mininteger");
+  setrandfunc(L);
   return 1;
 }
 
@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -244,6 +245,95 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 /* }====================================================== */
 
 
+/*
+** {==================================================================
+** Fast path for plain decimal numerals
+** ===================================================================
+*/
+
+/*
+** The fast path needs double operations rounded once, to double; that
+** is only known when the evaluation method is reported as 0 (C89
+** headers do not report it, and x87 code may use extended precision).
+*/
+#if defined(FLT_EVAL_METHOD)
+#define l_evaldouble	(FLT_EVAL_METHOD == 0)
+#elif defined(__FLT_EVAL_METHOD__)
+#define l_evaldouble	(__FLT_EVAL_METHOD__ == 0)
+#else
+#define l_evaldouble	0
+#endif
+
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && l_evaldouble	/* { */
+
+/* maximum number of significant digits handled by the fast path */
+#define MAXFASTDIGITS	15
+
+/*
+** Convert a decimal numeral with at most MAXFASTDIGITS significant
+** digits and a decimal exponent of at most 22 in absolute value. Both
+** the significand and the power of 10 are then exact doubles, so
+** a single multiplication or division gives the correctly rounded
+** result (Clinger's fast path), which is what 'strtod' gives too.
+** Only '.' is accepted as the radix mark. Returns NULL if 's' is not
+** such a numeral, leaving it to the general conversion.
+*/
+static const char *l_str2dfast (const char *s, lua_Number *result) {
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  double m = 0;  /* significand */
+  int nd = 0;  /* number of significant digits */
+  int e = 0;  /* decimal exponent */
+  int any = 0;  /* read any digit? */
+  int neg;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = isneg(&s);
+  for (; lisdigit(cast_uchar(*s)); s++, any = 1) {
+    if (m == 0 && *s == '0') continue;  /* skip leading zeros */
+    if (++nd > MAXFASTDIGITS) return NULL;
+    m = m * 10 + (*s - '0');
+  }
+  if (*s == '.') {
+    for (s++; lisdigit(cast_uchar(*s)); s++, any = 1) {
+      if (--e < -2 * MAXFASTDIGITS) return NULL;  /* too small */
+      if (m == 0 && *s == '0') continue;  /* skip leading zeros */
+      if (++nd > MAXFASTDIGITS) return NULL;
+      m = m * 10 + (*s - '0');
+    }
+  }
+  if (!any) return NULL;
+  if (*s == 'e' || *s == 'E') {
+    int exp1 = 0;
+    int neg1;
+    s++;  /* skip 'e' */
+    neg1 = isneg(&s);
+    if (!lisdigit(cast_uchar(*s)))
+      return NULL;  /* invalid; must have at least one digit */
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      if (exp1 > 1000) return NULL;  /* too large */
+      exp1 = exp1 * 10 + (*s - '0');
+    }
+    e += neg1 ? -exp1 : exp1;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (*s != '\0' || e < -22 || e > 22)
+    return NULL;
+  m = (e < 0) ? m / powers[-e] : m * powers[e];
+  *result = neg ? -m : m;
+  return s;
+}
+
+#else				/* }{ */
+
+#define l_str2dfast(s,r)	NULL
+
+#endif				/* } */
+
+/* }================================================================== */
+
+
 /* maximum length of a numeral */
 #if !defined (L_MAXLENNUM)
 #define L_MAXLENNUM	200
@@ -278,6 +368,8 @@ static const char *l_str2d (const char *s, lua_Number *result) {
   int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
+  if (mode != 'x' && (endptr = l_str2dfast(s, result)) != NULL)
+    return endptr;  /* plain decimal numeral */
   endptr = l_str2dloc(s, result, mode);  /* try to convert */
   if (endptr == NULL) {  /* failed? may be a different locale */
     char buff[L_MAXLENNUM + 1];
@@ -367,10 +459,77 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 #define MAXNUMBER2STR	50
 
 
+/*
+** Convert an integer to its decimal numeral, as "%d" would, but
+** without going through 'snprintf'. 'buff' needs room for the digits,
+** the sign and a '\0'. Returns the length of the result.
+*/
+LUA_API int luaO_int2str (char *buff, lua_Integer x) {
+  char digits[MAXNUMBER2STR];
+  char *p = digits + sizeof(digits);
+  lua_Unsigned u = l_castS2U(x);
+  int len;
+  if (x < 0) u = 0u - u;  /* absolute value (also correct for minint) */
+  do {
+    *--p = cast(char, '0' + cast_int(u % 10));
+    u /= 10;
+  } while (u != 0);
+  if (x < 0) *--p = '-';
+  len = cast_int(digits + sizeof(digits) - p);
+  memcpy(buff, p, len);
+  buff[len] = '\0';
+  return len;
+}
+
+
+/*
+** Convert a float to a string. Floats that are exactly the nearest
+** double to a decimal 'm / 10^k' with at most 14 significant digits
+** and that "%.14g" writes in fixed notation (that is, with magnitude
+** in [1e-4, 1e14)) are written directly from 'm' and 'k'; the result
+** is the same as "%.14g", as rounding 'x' to 14 digits can only give
+** 'm / 10^k' back. Other floats go through 'lua_number2str'.
+*/
+static int flt2str (char *buff, lua_Number x) {
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE
+  lua_Number ax = l_mathop(fabs)(x);
+  if (ax >= cast_num(1e-4) && ax < cast_num(1e14)) {
+    lua_Number p = 1;  /* 10^k */
+    int k;
+    for (k = 0; ax * p < cast_num(1e14); k++, p *= 10) {
+      lua_Number m = l_mathop(floor)(ax * p + cast_num(0.5));
+      if (m / p == ax) {  /* 'x' is the nearest double to 'm / 10^k'? */
+        char digits[MAXNUMBER2STR];
+        int nd = luaO_int2str(digits, cast(lua_Integer, m));
+        int len = 0;
+        if (x < 0) buff[len++] = '-';
+        if (nd > k) {  /* has an integral part? */
+          memcpy(buff + len, digits, nd - k);
+          len += nd - k;
+        }
+        else
+          buff[len++] = '0';
+        if (k > 0) {  /* has a fractional part? */
+          buff[len++] = lua_getlocaledecpoint();
+          for (; nd < k; k--)  /* leading zeros of fractional part */
+            buff[len++] = '0';
+          memcpy(buff + len, digits + nd - k, k);
+          len += k;
+        }
+        buff[len] = '\0';
+        return len;
+      }
+    }
+  }
+#endif
+  return lua_number2str(buff, MAXNUMBER2STR, x);
+}
+
+
 /*
 ** Convert a number object to a string
 把数字：整型或者浮点型 转成 TString 类型
-先用 snprintf 格式化成 char 字符串，然后创建 TString，最后设置到原来的整型变量中 
+先格式化成 char 字符串，然后创建 TString，最后设置到原来的整型变量中 
 */
 void luaO_tostring (lua_State *L, StkId obj) {
   char buff[MAXNUMBER2STR];
@@ -379,7 +538,7 @@ void luaO_tostring (lua_State *L, StkId obj) {
   if (ttisinteger(obj))
     len = lua_integer2str(buff, sizeof(buff), ivalue(obj));
   else {
-    len = lua_number2str(buff, sizeof(buff), fltvalue(obj));
+    len = flt2str(buff, fltvalue(obj));
 #if !defined(LUA_COMPAT_FLOATSTRING)
     if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
       buff[len++] = lua_getlocaledecpoint();
@@ -0,0 +1,432 @@
+/*
+** $Id: lserlib.c $
+** Standard library for binary serialization of Lua values
+** See Copyright Notice in lua.h
+*/
+
+#define lserlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** Format of a serialized value: a header (format version and size of
+** a float) followed by the value, where each value is a tag byte
+** followed by its contents:
+**   nil, false, true: nothing
+**   integer: zigzag-encoded varint
+**   float: the raw bytes of a 'lua_Number' (so, floats can only be
+**          decoded by a build with the same float format)
+**   string: varint length + bytes
+**   table: varint size of array part; uint32 (little endian) number of
+**          other entries (a hint for presizing); array values; key-value
+**          pairs for other entries; a nil tag
+**   reference: varint index of a previous string or table
+** Strings and tables are numbered (from 1) in the order they appear,
+** so repeated strings, shared tables, and cycles are written only
+** once. Metatables are not serialized.
+*/
+
+#define SER_VERSION	1
+
+#define T_NIL		0
+#define T_FALSE		1
+#define T_TRUE		2
+#define T_INT		3
+#define T_FLOAT		4
+#define T_STRING	5
+#define T_TABLE		6
+#define T_REF		7
+
+
+/* maximum nesting of tables (to bound the C stack) */
+#if !defined(LUAI_MAXSERDEPTH)
+#define LUAI_MAXSERDEPTH	200
+#endif
+
+
+/*
+** {======================================================
+** Encoder
+** =======================================================
+*/
+
+typedef struct Encoder {
+  lua_State *L;
+  char *b;  /* buffer (inside a userdata at stack index 'bidx') */
+  size_t n;  /* number of bytes in buffer */
+  size_t size;  /* buffer size */
+  int bidx;  /* stack index of buffer */
+  int ridx;  /* stack index of table mapping objects to references */
+  lua_Integer nrefs;  /* number of objects already in 'ridx' */
+  int depth;  /* current nesting of tables */
+} Encoder;
+
+
+/*
+** Make room for 'sz' more bytes. The buffer lives in a userdata, so
+** that it is collected even if the encoding raises an error.
+*/
+static char *prepbuff (Encoder *e, size_t sz) {
+  if (e->size - e->n < sz) {
+    char *newb;
+    size_t newsize = e->size * 2;
+    if (newsize - e->n < sz) {  /* not big enough? */
+      if (sz > ((size_t)~(size_t)0) - e->n)
+        luaL_error(e->L, "serialized data too large");
+      newsize = e->n + sz;
+    }
+    newb = (char *)lua_newuserdata(e->L, newsize);
+    memcpy(newb, e->b, e->n);
+    lua_replace(e->L, e->bidx);  /* old buffer will be collected */
+    e->b = newb;
+    e->size = newsize;
+  }
+  return e->b + e->n;
+}
+
+
+static void addbyte (Encoder *e, int c) {
+  *prepbuff(e, 1) = (char)c;
+  e->n++;
+}
+
+
+static void addbytes (Encoder *e, const void *s, size_t l) {
+  memcpy(prepbuff(e, l), s, l);
+  e->n += l;
+}
+
+
+static void addvarint (Encoder *e, lua_Unsigned v) {
+  char *p = prepbuff(e, sizeof(lua_Unsigned) * 8 / 7 + 1);
+  size_t i = 0;
+  while (v >= 0x80) {
+    p[i++] = (char)((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  p[i++] = (char)v;
+  e->n += i;
+}
+
+
+/*
+** If the object on the top of the stack was already written, write a
+** reference to it and return 1. Otherwise, give it the next reference
+** number and return 0.
+*/
+static int checkref (Encoder *e) {
+  lua_State *L = e->L;
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, e->ridx) == LUA_TNUMBER) {
+    addbyte(e, T_REF);
+    addvarint(e, (lua_Unsigned)lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    return 1;
+  }
+  lua_pop(L, 1);
+  lua_pushvalue(L, -1);
+  lua_pushinteger(L, ++e->nrefs);
+  lua_rawset(L, e->ridx);
+  return 0;
+}
+
+
+static void encode (Encoder *e);
+
+
+static void encodetable (Encoder *e) {
+  lua_State *L = e->L;
+  lua_Integer i, narr = (lua_Integer)lua_rawlen(L, -1);
+  unsigned long nhash = 0;
+  size_t hint;
+  int t = lua_gettop(L);
+  if (++e->depth > LUAI_MAXSERDEPTH)
+    luaL_error(L, "table nesting too deep to serialize");
+  /* key, value, copy of key, and copy plus index from 'checkref' */
+  luaL_checkstack(L, 5, "table nesting too deep to serialize");
+  addbyte(e, T_TABLE);
+  addvarint(e, (lua_Unsigned)narr);
+  hint = e->n;  /* position of the hint, filled in below */
+  addbytes(e, "\0\0\0\0", 4);
+  for (i = 1; i <= narr; i++) {  /* array part */
+    lua_rawgeti(L, t, i);
+    encode(e);
+    lua_pop(L, 1);
+  }
+  lua_pushnil(L);
+  while (lua_next(L, t)) {  /* other entries */
+    if (lua_isinteger(L, -2)) {
+      lua_Integer k = lua_tointeger(L, -2);
+      if (1 <= k && k <= narr) {  /* already written in the array part? */
+        lua_pop(L, 1);
+        continue;
+      }
+    }
+    lua_pushvalue(L, -2);
+    encode(e);  /* key */
+    lua_pop(L, 1);
+    encode(e);  /* value */
+    lua_pop(L, 1);
+    nhash++;
+  }
+  addbyte(e, T_NIL);
+  if (nhash > 0xFFFFFFFFul) nhash = 0xFFFFFFFFul;  /* it is only a hint */
+  for (i = 0; i < 4; i++, nhash >>= 8)
+    e->b[hint + i] = (char)(nhash & 0xFF);
+  e->depth--;
+}
+
+
+/* encode the value on the top of the stack */
+static void encode (Encoder *e) {
+  lua_State *L = e->L;
+  switch (lua_type(L, -1)) {
+    case LUA_TNIL: addbyte(e, T_NIL); break;
+    case LUA_TBOOLEAN:
+      addbyte(e, lua_toboolean(L, -1) ? T_TRUE : T_FALSE);
+      break;
+    case LUA_TNUMBER: {
+      if (lua_isinteger(L, -1)) {
+        lua_Unsigned u = (lua_Unsigned)lua_tointeger(L, -1);
+        addbyte(e, T_INT);
+        addvarint(e, (u << 1) ^ (0u - (u >> (sizeof(u) * 8 - 1))));
+      }
+      else {
+        lua_Number n = lua_tonumber(L, -1);
+        addbyte(e, T_FLOAT);
+        addbytes(e, &n, sizeof(n));
+      }
+      break;
+    }
+    case LUA_TSTRING: {
+      if (!checkref(e)) {
+        size_t l;
+        const char *s = lua_tolstring(L, -1, &l);
+        addbyte(e, T_STRING);
+        addvarint(e, (lua_Unsigned)l);
+        addbytes(e, s, l);
+      }
+      break;
+    }
+    case LUA_TTABLE: {
+      if (!checkref(e))
+        encodetable(e);
+      break;
+    }
+    default:
+      luaL_error(L, "cannot serialize a %s value", luaL_typename(L, -1));
+  }
+}
+
+
+static int ser_encode (lua_State *L) {
+  Encoder e;
+  luaL_checkany(L, 1);
+  lua_settop(L, 1);
+  e.L = L;
+  e.size = LUAL_BUFFERSIZE;
+  e.n = 0;
+  e.b = (char *)lua_newuserdata(L, e.size);
+  e.bidx = 2;
+  lua_newtable(L);
+  e.ridx = 3;
+  e.nrefs = 0;
+  e.depth = 0;
+  addbyte(&e, SER_VERSION);
+  addbyte(&e, (int)sizeof(lua_Number));
+  lua_pushvalue(L, 1);
+  encode(&e);
+  lua_pushlstring(L, e.b, e.n);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Decoder
+** =======================================================
+*/
+
+typedef struct Decoder {
+  lua_State *L;
+  const char *p;  /* current position */
+  const char *end;  /* end of data */
+  int ridx;  /* stack index of array of referenced objects */
+  lua_Integer nrefs;  /* number of objects in 'ridx' */
+  int depth;  /* current nesting of tables */
+  size_t budget;  /* elements that tables may still claim (see below) */
+} Decoder;
+
+
+static int malformed (Decoder *d) {
+  return luaL_error(d->L, "malformed serialized data");
+}
+
+
+static const char *getbytes (Decoder *d, size_t l) {
+  const char *p = d->p;
+  if ((size_t)(d->end - p) < l)
+    malformed(d);
+  d->p += l;
+  return p;
+}
+
+
+#define getbyte(d)	((unsigned char)*getbytes(d, 1))
+
+
+static lua_Unsigned getvarint (Decoder *d) {
+  lua_Unsigned v = 0;
+  int shift = 0;
+  for (;;) {
+    int c = getbyte(d);
+    if (shift >= (int)sizeof(lua_Unsigned) * 8)
+      malformed(d);
+    v |= (lua_Unsigned)(c & 0x7F) << shift;
+    if (!(c & 0x80)) return v;
+    shift += 7;
+  }
+}
+
+
+/* add the object on the top of the stack to the referenced ones */
+static void addref (Decoder *d) {
+  lua_pushvalue(d->L, -1);
+  lua_rawseti(d->L, d->ridx, ++d->nrefs);
+}
+
+
+static void decode (Decoder *d);
+
+
+static void decodetable (Decoder *d) {
+  lua_State *L = d->L;
+  lua_Unsigned narr = getvarint(d);
+  const unsigned char *h = (const unsigned char *)getbytes(d, 4);
+  unsigned long nhash = (unsigned long)h[0] | ((unsigned long)h[1] << 8) |
+                        ((unsigned long)h[2] << 16) | ((unsigned long)h[3] << 24);
+  lua_Integer i;
+  if (++d->depth > LUAI_MAXSERDEPTH)
+    luaL_error(L, "table nesting too deep to deserialize");
+  /* table, key, value and copy of value (from 'addref') */
+  luaL_checkstack(L, 4, "table nesting too deep to deserialize");
+  /* Every array element and every key and value starts with its own
+     tag byte in the input, so all tables together cannot claim more
+     than 'narr + 2*nhash' elements over the whole input; sizes are
+     charged against that shared budget before being trusted. */
+  if (narr > (lua_Unsigned)d->budget || narr > (lua_Unsigned)INT_MAX ||
+      nhash > (d->budget - (size_t)narr) / 2 || nhash > (unsigned long)INT_MAX)
+    malformed(d);
+  d->budget -= (size_t)narr + 2 * (size_t)nhash;
+  lua_createtable(L, (int)narr, (int)nhash);
+  addref(d);
+  for (i = 1; (lua_Unsigned)i <= narr; i++) {
+    decode(d);
+    lua_rawseti(L, -2, i);
+  }
+  for (;;) {
+    if (d->p < d->end && *d->p == T_NIL) {  /* end of entries? */
+      d->p++;
+      break;
+    }
+    decode(d);  /* key */
+    if (lua_isnil(L, -1))
+      malformed(d);
+    decode(d);  /* value */
+    lua_rawset(L, -3);
+  }
+  d->depth--;
+}
+
+
+/* decode a value and push it on the stack */
+static void decode (Decoder *d) {
+  lua_State *L = d->L;
+  switch (getbyte(d)) {
+    case T_NIL: lua_pushnil(L); break;
+    case T_FALSE: lua_pushboolean(L, 0); break;
+    case T_TRUE: lua_pushboolean(L, 1); break;
+    case T_INT: {
+      lua_Unsigned u = getvarint(d);
+      lua_pushinteger(L, (lua_Integer)((u >> 1) ^ (0u - (u & 1))));
+      break;
+    }
+    case T_FLOAT: {
+      lua_Number n;
+      memcpy(&n, getbytes(d, sizeof(n)), sizeof(n));
+      lua_pushnumber(L, n);
+      break;
+    }
+    case T_STRING: {
+      lua_Unsigned l = getvarint(d);
+      if (l > (lua_Unsigned)(d->end - d->p))
+        malformed(d);
+      lua_pushlstring(L, getbytes(d, (size_t)l), (size_t)l);
+      addref(d);
+      break;
+    }
+    case T_TABLE: decodetable(d); break;
+    case T_REF: {
+      lua_Unsigned r = getvarint(d);
+      if (r < 1 || r > (lua_Unsigned)d->nrefs)
+        malformed(d);
+      lua_rawgeti(L, d->ridx, (lua_Integer)r);
+      break;
+    }
+    default: malformed(d);  /* unknown tag */
+  }
+}
+
+
+static int ser_decode (lua_State *L) {
+  Decoder d;
+  size_t l;
+  const char *s = luaL_checklstring(L, 1, &l);
+  lua_settop(L, 1);
+  d.L = L;
+  d.p = s;
+  d.end = s + l;
+  d.budget = l;
+  lua_newtable(L);
+  d.ridx = 2;
+  d.nrefs = 0;
+  d.depth = 0;
+  if (getbyte(&d) != SER_VERSION)
+    return luaL_error(L, "serialized data has an unknown format version");
+  if (getbyte(&d) != sizeof(lua_Number))
+    return luaL_error(L, "serialized data has an incompatible float format");
+  decode(&d);
+  if (d.p != d.end)
+    malformed(&d);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg ser_funcs[] = {
+  {"encode", ser_encode},
+  {"decode", ser_decode},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_serialize (lua_State *L) {
+  luaL_newlib(L, ser_funcs);
+  return 1;
+}
+
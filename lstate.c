@@ -104,11 +104,32 @@ void luaE_setdebt (global_State *g, l_mem debt) {
   g->GCdebt = debt;
 }
 
+/*
+** Maximum number of free thread stacks and of free CallInfo structures
+** that a state keeps for reuse by new coroutines
+*/
+#if !defined(LUAI_MAXSTACKPOOL)
+#define LUAI_MAXSTACKPOOL	256
+#endif
+
+#if !defined(LUAI_MAXCIPOOL)
+#define LUAI_MAXCIPOOL		1024
+#endif
+
+
 /*
 创建一个函数调用栈节点，会链接到 lua_state.ci 链表里，作为表头。
 */
 CallInfo *luaE_extendCI (lua_State *L) {
-  CallInfo *ci = luaM_new(L, CallInfo);
+  global_State *g = G(L);
+  CallInfo *ci;
+  if (g->cipool != NULL) {  /* reuse a free structure */
+    ci = g->cipool;
+    g->cipool = ci->next;
+    g->ncipool--;
+  }
+  else
+    ci = luaM_new(L, CallInfo);
   lua_assert(L->ci->next == NULL);
   L->ci->next = ci;
   ci->previous = L->ci;
@@ -159,9 +180,16 @@ ci->top 指向 ci->func 上面的 20 个元素的位置，这20个元素空间
 作为参数传递的地方。
 */
 static void stack_init (lua_State *L1, lua_State *L) {
+  global_State *g = G(L);
   int i; CallInfo *ci;
   /* 分配堆栈空间       initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);  // 分配一定数量个 TValue 数据栈空间
+  if (g->stackpool != NULL) {  /* reuse a free stack? */
+    L1->stack = g->stackpool;
+    g->stackpool = cast(TValue *, pvalue(L1->stack));
+    g->nstackpool--;
+  }
+  else
+    L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);  // 分配一定数量个 TValue 数据栈空间
   L1->stacksize = BASIC_STACK_SIZE;
   for (i = 0; i < BASIC_STACK_SIZE; i++)
     setnilvalue(L1->stack + i);  /* 初始化为 nil 值。 erase new stack */
@@ -188,6 +216,56 @@ static void freestack (lua_State *L) {
 }
 
 
+/*
+** Free the stack of a dead thread, keeping its CallInfo structures and
+** (if it still has its initial size) its stack array in the pools of
+** the state, for reuse by new threads. Whatever does not fit in the
+** pools is really freed. (Pooled memory stays counted as in use.)
+*/
+static void recyclestack (lua_State *L) {
+  global_State *g = G(L);
+  CallInfo *ci;
+  if (L->stack == NULL)
+    return;  /* stack not completely built yet */
+  L->ci = &L->base_ci;
+  while ((ci = L->base_ci.next) != NULL && g->ncipool < LUAI_MAXCIPOOL) {
+    L->base_ci.next = ci->next;  /* move 'ci' to the pool */
+    ci->next = g->cipool;
+    g->cipool = ci;
+    g->ncipool++;
+    L->nci--;
+  }
+  if (L->stacksize == BASIC_STACK_SIZE && g->nstackpool < LUAI_MAXSTACKPOOL) {
+    luaE_freeCI(L);  /* free structures that did not fit in the pool */
+    lua_assert(L->nci == 0);
+    setpvalue(L->stack, g->stackpool);  /* link stack into the pool */
+    g->stackpool = L->stack;
+    g->nstackpool++;
+  }
+  else
+    freestack(L);
+}
+
+
+/*
+** Free all stacks and CallInfo structures kept for reuse
+*/
+void luaE_freepools (lua_State *L) {
+  global_State *g = G(L);
+  while (g->stackpool != NULL) {
+    TValue *stack = g->stackpool;
+    g->stackpool = cast(TValue *, pvalue(stack));
+    luaM_freearray(L, stack, BASIC_STACK_SIZE);
+  }
+  while (g->cipool != NULL) {
+    CallInfo *ci = g->cipool;
+    g->cipool = ci->next;
+    luaM_free(L, ci);
+  }
+  g->nstackpool = g->ncipool = 0;
+}
+
+
 /*
 ** Create registry table and its predefined values
 初始化寄存器。
@@ -264,6 +342,7 @@ static void close_state (lua_State *L) {
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaE_freepools(L);
   freestack(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
@@ -310,7 +389,7 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
-  freestack(L1);
+  recyclestack(L1);
   luaM_free(L, l);
 }
 
@@ -356,6 +435,9 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
+  g->stackpool = NULL;
+  g->cipool = NULL;
+  g->nstackpool = g->ncipool = 0;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcfinnum = 0;
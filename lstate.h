@@ -180,6 +180,10 @@ typedef struct global_State {
   GCObject *tobefnz;  	/* list of userdata to be GC */
   GCObject *fixedgc;  	/* list of objects not to be collected */
   struct lua_State *twups;  /* 闭包了当前线程（协程）变量的其他线程列表. list of threads with open upvalues */
+  TValue *stackpool;  	/* free thread stacks (of size BASIC_STACK_SIZE) */
+  CallInfo *cipool;  	/* free CallInfo structures */
+  int nstackpool;  		/* number of stacks in 'stackpool' */
+  int ncipool;  		/* number of structures in 'cipool' */
   unsigned int gcfinnum;/* number of finalizers to call in each GC step */
   int gcpause;  		/* size of pause between successive GCs */
   int gcstepmul;  		/* GC 'granularity' */
@@ -291,6 +295,7 @@ LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
+LUAI_FUNC void luaE_freepools (lua_State *L);
 
 
 #endif
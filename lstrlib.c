@@ -1013,6 +1013,29 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
+/*
+** Format integer 'n' for a plain '%d', '%i', '%x' or '%X' (without
+** flags, width or precision), giving the same result as 'l_sprintf'
+** without its cost; decimals go through 'lua_integer2str'. Returns
+** the number of bytes written to 'buff'.
+*/
+static int plainint (char *buff, lua_Integer n, int conv) {
+  static const char hexdigits[] = "0123456789abcdef0123456789ABCDEF";
+  char digits[2 * sizeof(lua_Integer)];
+  char *p = digits + sizeof(digits);
+  lua_Unsigned u = (lua_Unsigned)n;
+  const char *hd;
+  int len;
+  if (conv == 'd' || conv == 'i')
+    return lua_integer2str(buff, MAX_ITEM, n);
+  hd = (conv == 'x') ? hexdigits : hexdigits + 16;
+  do { *--p = hd[u & 0xf]; u >>= 4; } while (u != 0);
+  len = (int)(digits + sizeof(digits) - p);
+  memcpy(buff, p, len);
+  return len;
+}
+
+
 static int str_format (lua_State *L) {
   int top = lua_gettop(L);
   int arg = 1;
@@ -1022,8 +1045,13 @@ static int str_format (lua_State *L) {
   luaL_Buffer b;
   luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
-    if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+    if (*strfrmt != L_ESC) {  /* copy a run of plain characters */
+      const char *e = (const char *)memchr(strfrmt, L_ESC,
+                                           strfrmt_end - strfrmt);
+      if (e == NULL) e = strfrmt_end;
+      luaL_addlstring(&b, strfrmt, e - strfrmt);
+      strfrmt = e;
+    }
     else if (*++strfrmt == L_ESC)
       luaL_addchar(&b, *strfrmt++);  /* %% */
     else { /* format item */
@@ -1041,8 +1069,12 @@ static int str_format (lua_State *L) {
         case 'd': case 'i':
         case 'o': case 'u': case 'x': case 'X': {
           lua_Integer n = luaL_checkinteger(L, arg);
-          addlenmod(form, LUA_INTEGER_FRMLEN);
-          nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACINT)n);
+          if (form[2] == '\0' && form[1] != 'o' && form[1] != 'u')
+            nb = plainint(buff, n, form[1]);  /* no modifiers */
+          else {
+            addlenmod(form, LUA_INTEGER_FRMLEN);
+            nb = l_sprintf(buff, MAX_ITEM, form, (LUAI_UACINT)n);
+          }
           break;
         }
         case 'a': case 'A':
@@ -1258,15 +1290,15 @@ static KOption getoption (Header *h, const char **fmt, int *size) {
 
 /*
 ** Read, classify, and fill other details about the next option.
-** 'psize' is filled with option's size, 'notoalign' with its
-** alignment requirements.
+** 'psize' is filled with option's size, 'palign' with its alignment
+** (0 if it needs no alignment).
 ** Local variable 'size' gets the size to be aligned. (Kpadal option
 ** always gets its full alignment, other options are limited by
 ** the maximum alignment ('maxalign'). Kchar option needs no alignment
 ** despite its size.
 */
-static KOption getdetails (Header *h, size_t totalsize,
-                           const char **fmt, int *psize, int *ntoalign) {
+static KOption getdetails (Header *h, const char **fmt,
+                           int *psize, int *palign) {
   KOption opt = getoption(h, fmt, psize);
   int align = *psize;  /* usually, alignment follows size */
   if (opt == Kpaddalign) {  /* 'X' gets alignment from following option */
@@ -1274,18 +1306,23 @@ static KOption getdetails (Header *h, size_t totalsize,
       luaL_argerror(h->L, 1, "invalid next option for option 'X'");
   }
   if (align <= 1 || opt == Kchar)  /* need no alignment? */
-    *ntoalign = 0;
+    *palign = 0;
   else {
     if (align > h->maxalign)  /* enforce maximum alignment */
       align = h->maxalign;
     if ((align & (align - 1)) != 0)  /* is 'align' not a power of 2? */
       luaL_argerror(h->L, 1, "format asks for alignment not power of 2");
-    *ntoalign = (align - (int)(totalsize & (align - 1))) & (align - 1);
+    *palign = align;
   }
   return opt;
 }
 
 
+/* number of padding bytes to align 'pos' to 'align' (0 or a power of 2) */
+#define topad(pos,align)  \
+	((align) == 0 ? 0 : ((align) - (int)((pos) & ((align) - 1))) & ((align) - 1))
+
+
 /*
 ** Pack integer 'n' with 'size' bytes and 'islittle' endianness.
 ** The final 'if' handles the case when 'size' is larger than
@@ -1327,6 +1364,85 @@ static void copywithendian (volatile char *dest, volatile const char *src,
 }
 
 
+/*
+** Pack one option into buffer 'b', taking its value (if any) from
+** argument 'arg'. Returns the number of arguments used (0 or 1).
+*/
+static int packitem (lua_State *L, luaL_Buffer *b, KOption opt,
+                     int size, int align, int islittle, int arg,
+                     size_t *totalsize) {
+  int ntoalign = topad(*totalsize, align);
+  *totalsize += ntoalign + size;
+  while (ntoalign-- > 0)
+   luaL_addchar(b, LUAL_PACKPADBYTE);  /* fill alignment */
+  switch (opt) {
+    case Kint: {  /* signed integers */
+      lua_Integer n = luaL_checkinteger(L, arg);
+      if (size < SZINT) {  /* need overflow check? */
+        lua_Integer lim = (lua_Integer)1 << ((size * NB) - 1);
+        luaL_argcheck(L, -lim <= n && n < lim, arg, "integer overflow");
+      }
+      packint(b, (lua_Unsigned)n, islittle, size, (n < 0));
+      break;
+    }
+    case Kuint: {  /* unsigned integers */
+      lua_Integer n = luaL_checkinteger(L, arg);
+      if (size < SZINT)  /* need overflow check? */
+        luaL_argcheck(L, (lua_Unsigned)n < ((lua_Unsigned)1 << (size * NB)),
+                         arg, "unsigned overflow");
+      packint(b, (lua_Unsigned)n, islittle, size, 0);
+      break;
+    }
+    case Kfloat: {  /* floating-point options */
+      volatile Ftypes u;
+      char *buff = luaL_prepbuffsize(b, size);
+      lua_Number n = luaL_checknumber(L, arg);  /* get argument */
+      if (size == sizeof(u.f)) u.f = (float)n;  /* copy it into 'u' */
+      else if (size == sizeof(u.d)) u.d = (double)n;
+      else u.n = n;
+      /* move 'u' to final result, correcting endianness if needed */
+      copywithendian(buff, u.buff, size, islittle);
+      luaL_addsize(b, size);
+      break;
+    }
+    case Kchar: {  /* fixed-size string */
+      size_t len;
+      const char *s = luaL_checklstring(L, arg, &len);
+      luaL_argcheck(L, len <= (size_t)size, arg,
+                       "string longer than given size");
+      luaL_addlstring(b, s, len);  /* add string */
+      while (len++ < (size_t)size)  /* pad extra space */
+        luaL_addchar(b, LUAL_PACKPADBYTE);
+      break;
+    }
+    case Kstring: {  /* strings with length count */
+      size_t len;
+      const char *s = luaL_checklstring(L, arg, &len);
+      luaL_argcheck(L, size >= (int)sizeof(size_t) ||
+                       len < ((size_t)1 << (size * NB)),
+                       arg, "string length does not fit in given size");
+      packint(b, (lua_Unsigned)len, islittle, size, 0);  /* pack length */
+      luaL_addlstring(b, s, len);
+      *totalsize += len;
+      break;
+    }
+    case Kzstr: {  /* zero-terminated string */
+      size_t len;
+      const char *s = luaL_checklstring(L, arg, &len);
+      luaL_argcheck(L, strlen(s) == len, arg, "string contains zeros");
+      luaL_addlstring(b, s, len);
+      luaL_addchar(b, '\0');  /* add zero at the end */
+      *totalsize += len + 1;
+      break;
+    }
+    case Kpadding: luaL_addchar(b, LUAL_PACKPADBYTE);  /* FALLTHROUGH */
+    case Kpaddalign: case Knop:
+      return 0;  /* no argument used */
+  }
+  return 1;
+}
+
+
 static int str_pack (lua_State *L) {
   luaL_Buffer b;
   Header h;
@@ -1337,77 +1453,10 @@ static int str_pack (lua_State *L) {
   lua_pushnil(L);  /* mark to separate arguments from string buffer */
   luaL_buffinit(L, &b);
   while (*fmt != '\0') {
-    int size, ntoalign;
-    KOption opt = getdetails(&h, totalsize, &fmt, &size, &ntoalign);
-    totalsize += ntoalign + size;
-    while (ntoalign-- > 0)
-     luaL_addchar(&b, LUAL_PACKPADBYTE);  /* fill alignment */
-    arg++;
-    switch (opt) {
-      case Kint: {  /* signed integers */
-        lua_Integer n = luaL_checkinteger(L, arg);
-        if (size < SZINT) {  /* need overflow check? */
-          lua_Integer lim = (lua_Integer)1 << ((size * NB) - 1);
-          luaL_argcheck(L, -lim <= n && n < lim, arg, "integer overflow");
-        }
-        packint(&b, (lua_Unsigned)n, h.islittle, size, (n < 0));
-        break;
-      }
-      case Kuint: {  /* unsigned integers */
-        lua_Integer n = luaL_checkinteger(L, arg);
-        if (size < SZINT)  /* need overflow check? */
-          luaL_argcheck(L, (lua_Unsigned)n < ((lua_Unsigned)1 << (size * NB)),
-                           arg, "unsigned overflow");
-        packint(&b, (lua_Unsigned)n, h.islittle, size, 0);
-        break;
-      }
-      case Kfloat: {  /* floating-point options */
-        volatile Ftypes u;
-        char *buff = luaL_prepbuffsize(&b, size);
-        lua_Number n = luaL_checknumber(L, arg);  /* get argument */
-        if (size == sizeof(u.f)) u.f = (float)n;  /* copy it into 'u' */
-        else if (size == sizeof(u.d)) u.d = (double)n;
-        else u.n = n;
-        /* move 'u' to final result, correcting endianness if needed */
-        copywithendian(buff, u.buff, size, h.islittle);
-        luaL_addsize(&b, size);
-        break;
-      }
-      case Kchar: {  /* fixed-size string */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, len <= (size_t)size, arg,
-                         "string longer than given size");
-        luaL_addlstring(&b, s, len);  /* add string */
-        while (len++ < (size_t)size)  /* pad extra space */
-          luaL_addchar(&b, LUAL_PACKPADBYTE);
-        break;
-      }
-      case Kstring: {  /* strings with length count */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, size >= (int)sizeof(size_t) ||
-                         len < ((size_t)1 << (size * NB)),
-                         arg, "string length does not fit in given size");
-        packint(&b, (lua_Unsigned)len, h.islittle, size, 0);  /* pack length */
-        luaL_addlstring(&b, s, len);
-        totalsize += len;
-        break;
-      }
-      case Kzstr: {  /* zero-terminated string */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, strlen(s) == len, arg, "string contains zeros");
-        luaL_addlstring(&b, s, len);
-        luaL_addchar(&b, '\0');  /* add zero at the end */
-        totalsize += len + 1;
-        break;
-      }
-      case Kpadding: luaL_addchar(&b, LUAL_PACKPADBYTE);  /* FALLTHROUGH */
-      case Kpaddalign: case Knop:
-        arg--;  /* undo increment */
-        break;
-    }
+    int size, align;
+    KOption opt = getdetails(&h, &fmt, &size, &align);
+    arg += packitem(L, &b, opt, size, align, h.islittle, arg + 1,
+                    &totalsize);
   }
   luaL_pushresult(&b);
   return 1;
@@ -1420,9 +1469,9 @@ static int str_packsize (lua_State *L) {
   size_t totalsize = 0;  /* accumulate total size of result */
   initheader(L, &h);
   while (*fmt != '\0') {
-    int size, ntoalign;
-    KOption opt = getdetails(&h, totalsize, &fmt, &size, &ntoalign);
-    size += ntoalign;  /* total space used by option */
+    int size, align;
+    KOption opt = getdetails(&h, &fmt, &size, &align);
+    size += topad(totalsize, align);  /* total space used by option */
     luaL_argcheck(L, totalsize <= MAXSIZE - size, 1,
                      "format result too large");
     totalsize += size;
@@ -1473,6 +1522,63 @@ static lua_Integer unpackint (lua_State *L, const char *str,
 }
 
 
+/*
+** Unpack one option from 'data' at position '*ppos', pushing its value
+** (if any) and advancing '*ppos'. Returns the number of values pushed.
+*/
+static int unpackitem (lua_State *L, const char *data, size_t ld,
+                       KOption opt, int size, int align, int islittle,
+                       size_t *ppos) {
+  size_t pos = *ppos;
+  int ntoalign = topad(pos, align);
+  int n = 1;
+  if ((size_t)ntoalign + size > ~pos || pos + ntoalign + size > ld)
+    luaL_argerror(L, 2, "data string too short");
+  pos += ntoalign;  /* skip alignment */
+  switch (opt) {
+    case Kint:
+    case Kuint: {
+      lua_Integer res = unpackint(L, data + pos, islittle, size,
+                                     (opt == Kint));
+      lua_pushinteger(L, res);
+      break;
+    }
+    case Kfloat: {
+      volatile Ftypes u;
+      lua_Number num;
+      copywithendian(u.buff, data + pos, size, islittle);
+      if (size == sizeof(u.f)) num = (lua_Number)u.f;
+      else if (size == sizeof(u.d)) num = (lua_Number)u.d;
+      else num = u.n;
+      lua_pushnumber(L, num);
+      break;
+    }
+    case Kchar: {
+      lua_pushlstring(L, data + pos, size);
+      break;
+    }
+    case Kstring: {
+      size_t len = (size_t)unpackint(L, data + pos, islittle, size, 0);
+      luaL_argcheck(L, pos + len + size <= ld, 2, "data string too short");
+      lua_pushlstring(L, data + pos + size, len);
+      pos += len;  /* skip string */
+      break;
+    }
+    case Kzstr: {
+      size_t len = (int)strlen(data + pos);
+      lua_pushlstring(L, data + pos, len);
+      pos += len + 1;  /* skip string plus final '\0' */
+      break;
+    }
+    case Kpaddalign: case Kpadding: case Knop:
+      n = 0;  /* no value */
+      break;
+  }
+  *ppos = pos + size;
+  return n;
+}
+
+
 static int str_unpack (lua_State *L) {
   Header h;
   const char *fmt = luaL_checkstring(L, 1);
@@ -1483,59 +1589,203 @@ static int str_unpack (lua_State *L) {
   luaL_argcheck(L, pos <= ld, 3, "initial position out of string");
   initheader(L, &h);
   while (*fmt != '\0') {
-    int size, ntoalign;
-    KOption opt = getdetails(&h, pos, &fmt, &size, &ntoalign);
-    if ((size_t)ntoalign + size > ~pos || pos + ntoalign + size > ld)
-      luaL_argerror(L, 2, "data string too short");
-    pos += ntoalign;  /* skip alignment */
+    int size, align;
+    KOption opt = getdetails(&h, &fmt, &size, &align);
     /* stack space for item + next position */
     luaL_checkstack(L, 2, "too many results");
-    n++;
-    switch (opt) {
-      case Kint:
-      case Kuint: {
-        lua_Integer res = unpackint(L, data + pos, h.islittle, size,
-                                       (opt == Kint));
-        lua_pushinteger(L, res);
-        break;
-      }
-      case Kfloat: {
-        volatile Ftypes u;
-        lua_Number num;
-        copywithendian(u.buff, data + pos, size, h.islittle);
-        if (size == sizeof(u.f)) num = (lua_Number)u.f;
-        else if (size == sizeof(u.d)) num = (lua_Number)u.d;
-        else num = u.n;
-        lua_pushnumber(L, num);
-        break;
-      }
-      case Kchar: {
-        lua_pushlstring(L, data + pos, size);
-        break;
-      }
-      case Kstring: {
-        size_t len = (size_t)unpackint(L, data + pos, h.islittle, size, 0);
-        luaL_argcheck(L, pos + len + size <= ld, 2, "data string too short");
-        lua_pushlstring(L, data + pos + size, len);
-        pos += len;  /* skip string */
-        break;
-      }
-      case Kzstr: {
-        size_t len = (int)strlen(data + pos);
-        lua_pushlstring(L, data + pos, len);
-        pos += len + 1;  /* skip string plus final '\0' */
-        break;
-      }
-      case Kpaddalign: case Kpadding: case Knop:
-        n--;  /* undo increment */
-        break;
-    }
-    pos += size;
+    n += unpackitem(L, data, ld, opt, size, align, h.islittle, &pos);
   }
   lua_pushinteger(L, pos + 1);  /* next position */
   return n + 1;
 }
 
+
+/*
+** {======================================================
+** Compiled layouts: 'string.compilepack(fmt)' parses a format once
+** and returns an object with methods 'pack', 'unpack' and
+** 'unpackarray', which work as the corresponding functions
+** without parsing the format again.
+** =======================================================
+*/
+
+#define PACKLAYOUT	"PackLayout"
+
+
+/* an option of a compiled format */
+typedef struct PackItem {
+  unsigned char opt;  /* KOption */
+  unsigned char islittle;
+  int size;
+  int align;  /* alignment (0 if none) */
+} PackItem;
+
+
+typedef struct PackLayout {
+  int nitems;  /* number of items ('Knop' options are dropped) */
+  int nvalues;  /* number of values in a record */
+  PackItem item[1];  /* variable part */
+} PackLayout;
+
+
+#define checklayout(L)	((PackLayout *)luaL_checkudata(L, 1, PACKLAYOUT))
+
+
+static int str_compilepack (lua_State *L) {
+  Header h;
+  const char *fmt = luaL_checkstring(L, 1);
+  /* each item takes at least one character of the format */
+  PackLayout *pl = (PackLayout *)lua_newuserdata(L,
+                     sizeof(PackLayout) + strlen(fmt) * sizeof(PackItem));
+  pl->nitems = pl->nvalues = 0;
+  initheader(L, &h);
+  while (*fmt != '\0') {
+    int size, align;
+    KOption opt = getdetails(&h, &fmt, &size, &align);
+    if (opt != Knop) {
+      PackItem *item = &pl->item[pl->nitems++];
+      item->opt = (unsigned char)opt;
+      item->islittle = (unsigned char)h.islittle;
+      item->size = size;
+      item->align = align;
+      if (opt < Kpadding)  /* option has a value? */
+        pl->nvalues++;
+    }
+  }
+  luaL_setmetatable(L, PACKLAYOUT);
+  return 1;
+}
+
+
+static int layout_pack (lua_State *L) {
+  const PackLayout *pl = checklayout(L);
+  luaL_Buffer b;
+  int arg = 1;  /* current argument to pack */
+  size_t totalsize = 0;  /* accumulate total size of result */
+  int i;
+  lua_pushnil(L);  /* mark to separate arguments from string buffer */
+  luaL_buffinit(L, &b);
+  for (i = 0; i < pl->nitems; i++) {
+    const PackItem *item = &pl->item[i];
+    arg += packitem(L, &b, (KOption)item->opt, item->size, item->align,
+                    item->islittle, arg + 1, &totalsize);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+/*
+** Unpack one record. If 't' is not 0, values are stored in t[1..n];
+** otherwise they are left on the stack.
+*/
+static void unpackrecord (lua_State *L, const PackLayout *pl,
+                          const char *data, size_t ld, size_t *pos, int t) {
+  int n = 0;
+  int i;
+  for (i = 0; i < pl->nitems; i++) {
+    const PackItem *item = &pl->item[i];
+    if (unpackitem(L, data, ld, (KOption)item->opt, item->size,
+                   item->align, item->islittle, pos) && t != 0)
+      lua_rawseti(L, t, ++n);
+  }
+}
+
+
+static size_t layoutpos (lua_State *L, int arg, size_t ld) {
+  size_t pos = (size_t)posrelat(luaL_optinteger(L, arg, 1), ld) - 1;
+  luaL_argcheck(L, pos <= ld, arg, "initial position out of string");
+  return pos;
+}
+
+
+/*
+** layout:unpack(s [, pos [, t]]): without 't', returns the values and
+** the next position, as 'string.unpack'; with 't', stores the values
+** in t[1..n] and returns 't' and the next position.
+*/
+static int layout_unpack (lua_State *L) {
+  const PackLayout *pl = checklayout(L);
+  size_t ld;
+  const char *data = luaL_checklstring(L, 2, &ld);
+  size_t pos = layoutpos(L, 3, ld);
+  int t = 0;
+  if (lua_isnoneornil(L, 4))  /* values go to the stack */
+    luaL_checkstack(L, pl->nvalues + 1, "too many results");
+  else {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_settop(L, 4);
+    t = 4;
+  }
+  unpackrecord(L, pl, data, ld, &pos, t);
+  if (t != 0) lua_pushvalue(L, t);
+  lua_pushinteger(L, pos + 1);  /* next position */
+  return (t != 0) ? 2 : pl->nvalues + 1;
+}
+
+
+/*
+** Check whether every record of a layout consumes some bytes of the
+** data ('z' always reads its terminating zero; 'c0' and 'X' may read
+** nothing)
+*/
+static int consumesdata (const PackLayout *pl) {
+  int i;
+  for (i = 0; i < pl->nitems; i++) {
+    const PackItem *item = &pl->item[i];
+    if (item->size > 0 || (KOption)item->opt == Kzstr)
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+** layout:unpackarray(s, count [, pos]) unpacks 'count' consecutive
+** records, returning a list of them (each one a list of its values)
+** and the next position.
+*/
+static int layout_unpackarray (lua_State *L) {
+  const PackLayout *pl = checklayout(L);
+  size_t ld;
+  const char *data = luaL_checklstring(L, 2, &ld);
+  lua_Integer count = luaL_checkinteger(L, 3);
+  size_t pos = layoutpos(L, 4, ld);
+  lua_Integer i;
+  luaL_argcheck(L, 0 <= count && count < INT_MAX, 3, "invalid count");
+  luaL_argcheck(L, count == 0 || consumesdata(pl), 1,
+                "layout consumes no data");
+  /* records usually take some bytes; do not trust 'count' blindly */
+  lua_createtable(L, (int)((size_t)count <= ld - pos ? (size_t)count
+                                                    : ld - pos), 0);
+  for (i = 1; i <= count; i++) {
+    lua_createtable(L, pl->nvalues, 0);
+    unpackrecord(L, pl, data, ld, &pos, lua_gettop(L));
+    lua_rawseti(L, -2, i);
+  }
+  lua_pushinteger(L, pos + 1);  /* next position */
+  return 2;
+}
+
+
+static const luaL_Reg layoutmeth[] = {
+  {"pack", layout_pack},
+  {"unpack", layout_unpack},
+  {"unpackarray", layout_unpackarray},
+  {NULL, NULL}
+};
+
+
+static void createlayoutmeta (lua_State *L) {
+  luaL_newmetatable(L, PACKLAYOUT);  /* metatable for layouts */
+  lua_pushvalue(L, -1);  /* push metatable */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = metatable */
+  luaL_setfuncs(L, layoutmeth, 0);  /* add methods */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
 /* }====================================================== */
 
 
@@ -1557,6 +1807,7 @@ static const luaL_Reg strlib[] = {
   {"pack", str_pack},
   {"packsize", str_packsize},
   {"unpack", str_unpack},
+  {"compilepack", str_compilepack},
   {NULL, NULL}
 };
 
@@ -1579,6 +1830,7 @@ static void createmetatable (lua_State *L) {
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+  createlayoutmeta(L);
   return 1;
 }
 
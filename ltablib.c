@@ -58,6 +58,42 @@ static void checktab (lua_State *L, int arg, int what) {
 }
 
 
+/*
+** A "plain" table is a true table without a metatable. Its elements
+** can be accessed with raw operations, which skip all metamethod
+** checks and go straight to the array part of the table.
+*/
+static int isplain (lua_State *L, int arg) {
+  if (lua_type(L, arg) != LUA_TTABLE)
+    return 0;
+  else if (lua_getmetatable(L, arg)) {
+    lua_pop(L, 1);  /* remove metatable */
+    return 0;
+  }
+  else return 1;
+}
+
+
+/*
+** Like 'aux_getn', but also tells (in '*plain') whether the object
+** at index 'n' is a plain table, in which case its length is its
+** raw length.
+*/
+static lua_Integer plain_getn (lua_State *L, int n, int w, int *plain) {
+  if ((*plain = isplain(L, n)))
+    return (lua_Integer)lua_rawlen(L, n);
+  else
+    return aux_getn(L, n, w);
+}
+
+
+/* read/write element 'i' of object at index 'n', raw if 'plain' */
+#define geti(L,plain,n,i)  \
+	((plain) ? lua_rawgeti(L, n, i) : lua_geti(L, n, i))
+#define seti(L,plain,n,i)  \
+	((plain) ? lua_rawseti(L, n, i) : lua_seti(L, n, i))
+
+
 #if defined(LUA_COMPAT_MAXN)
 static int maxn (lua_State *L) {
   lua_Number max = 0;
@@ -77,7 +113,8 @@ static int maxn (lua_State *L) {
 
 
 static int tinsert (lua_State *L) {
-  lua_Integer e = aux_getn(L, 1, TAB_RW) + 1;  /* first empty element */
+  int plain;
+  lua_Integer e = plain_getn(L, 1, TAB_RW, &plain) + 1;  /* first empty */
   lua_Integer pos;  /* where to insert new element */
   switch (lua_gettop(L)) {
     case 2: {  /* called with only 2 arguments */
@@ -89,8 +126,8 @@ static int tinsert (lua_State *L) {
       pos = luaL_checkinteger(L, 2);  /* 2nd argument is the position */
       luaL_argcheck(L, 1 <= pos && pos <= e, 2, "position out of bounds");
       for (i = e; i > pos; i--) {  /* move up elements */
-        lua_geti(L, 1, i - 1);
-        lua_seti(L, 1, i);  /* t[i] = t[i - 1] */
+        geti(L, plain, 1, i - 1);
+        seti(L, plain, 1, i);  /* t[i] = t[i - 1] */
       }
       break;
     }
@@ -98,7 +135,7 @@ static int tinsert (lua_State *L) {
       return luaL_error(L, "wrong number of arguments to 'insert'");
     }
   }
-  lua_seti(L, 1, pos);  /* t[pos] = v */
+  seti(L, plain, 1, pos);  /* t[pos] = v */
   return 0;
 }
 
@@ -130,8 +167,11 @@ static int tmove (lua_State *L) {
   lua_Integer e = luaL_checkinteger(L, 3);
   lua_Integer t = luaL_checkinteger(L, 4);
   int tt = !lua_isnoneornil(L, 5) ? 5 : 1;  /* destination table */
+  int pf, pt;  /* whether source/destination are plain tables */
   checktab(L, 1, TAB_R);
   checktab(L, tt, TAB_W);
+  pf = isplain(L, 1);
+  pt = isplain(L, tt);
   if (e >= f) {  /* otherwise, nothing to move */
     lua_Integer n, i;
     luaL_argcheck(L, f > 0 || e < LUA_MAXINTEGER + f, 3,
@@ -141,14 +181,14 @@ static int tmove (lua_State *L) {
                   "destination wrap around");
     if (t > e || t <= f || (tt != 1 && !lua_compare(L, 1, tt, LUA_OPEQ))) {
       for (i = 0; i < n; i++) {
-        lua_geti(L, 1, f + i);
-        lua_seti(L, tt, t + i);
+        geti(L, pf, 1, f + i);
+        seti(L, pt, tt, t + i);
       }
     }
     else {
       for (i = n - 1; i >= 0; i--) {
-        lua_geti(L, 1, f + i);
-        lua_seti(L, tt, t + i);
+        geti(L, pf, 1, f + i);
+        seti(L, pt, tt, t + i);
       }
     }
   }
@@ -157,8 +197,9 @@ static int tmove (lua_State *L) {
 }
 
 
-static void addfield (lua_State *L, luaL_Buffer *b, lua_Integer i) {
-  lua_geti(L, 1, i);
+static void addfield (lua_State *L, luaL_Buffer *b, int plain,
+                                       lua_Integer i) {
+  geti(L, plain, 1, i);
   if (!lua_isstring(L, -1))
     luaL_error(L, "invalid value (%s) at index %d in table for 'concat'",
                   luaL_typename(L, -1), i);
@@ -166,20 +207,58 @@ static void addfield (lua_State *L, luaL_Buffer *b, lua_Integer i) {
 }
 
 
+/* estimated size for the textual representation of a number */
+#define NUMLENGUESS	8
+
+
+/*
+** Compute the size of the result of concatenating the elements
+** [i, last] of the plain table at index 1, so that the buffer can
+** be reserved only once. Numbers are only converted when added to
+** the buffer, so their sizes are guessed; if the guess is short, the
+** buffer simply grows as usual. The scan stops at the first value that
+** is neither a string nor a number, where 'addfield' will raise its
+** error. Returns 0 if the size overflows.
+*/
+static size_t concatsize (lua_State *L, lua_Integer i, lua_Integer last,
+                          size_t lsep) {
+  size_t total = 0;
+  for (; i <= last; i++) {
+    size_t l;
+    switch (lua_rawgeti(L, 1, i)) {
+      case LUA_TSTRING: l = lua_rawlen(L, -1); break;
+      case LUA_TNUMBER: l = NUMLENGUESS; break;
+      default: lua_pop(L, 1); return total;  /* invalid value */
+    }
+    lua_pop(L, 1);
+    if (i < last)
+      l += lsep;
+    if (l >= ((size_t)~(size_t)0) - total)  /* overflow? */
+      return 0;
+    total += l;
+  }
+  return total;
+}
+
+
 static int tconcat (lua_State *L) {
   luaL_Buffer b;
-  lua_Integer last = aux_getn(L, 1, TAB_R);
+  int plain;
+  lua_Integer last = plain_getn(L, 1, TAB_R, &plain);
   size_t lsep;
   const char *sep = luaL_optlstring(L, 2, "", &lsep);
   lua_Integer i = luaL_optinteger(L, 3, 1);
   last = luaL_optinteger(L, 4, last);
-  luaL_buffinit(L, &b);
+  if (plain && i < last)  /* reserve the whole result at once */
+    luaL_buffinitsize(L, &b, concatsize(L, i, last, lsep));
+  else
+    luaL_buffinit(L, &b);
   for (; i < last; i++) {
-    addfield(L, &b, i);
+    addfield(L, &b, plain, i);
     luaL_addlstring(&b, sep, lsep);
   }
   if (i == last)  /* add last value (if interval was not empty) */
-    addfield(L, &b, i);
+    addfield(L, &b, plain, i);
   luaL_pushresult(&b);
   return 1;
 }
@@ -206,16 +285,18 @@ static int pack (lua_State *L) {
 
 static int unpack (lua_State *L) {
   lua_Unsigned n;
+  int plain = isplain(L, 1);
   lua_Integer i = luaL_optinteger(L, 2, 1);
-  lua_Integer e = luaL_opt(L, luaL_checkinteger, 3, luaL_len(L, 1));
+  lua_Integer e = luaL_opt(L, luaL_checkinteger, 3,
+                     plain ? (lua_Integer)lua_rawlen(L, 1) : luaL_len(L, 1));
   if (i > e) return 0;  /* empty range */
   n = (lua_Unsigned)e - i;  /* number of elements minus 1 (avoid overflows) */
   if (n >= (unsigned int)INT_MAX  || !lua_checkstack(L, (int)(++n)))
     return luaL_error(L, "too many results to unpack");
   for (; i < e; i++) {  /* push arg[i..e - 1] (to avoid overflows) */
-    lua_geti(L, 1, i);
+    geti(L, plain, 1, i);
   }
-  lua_geti(L, 1, e);  /* push last element */
+  geti(L, plain, 1, e);  /* push last element */
   return (int)n;
 }
 
@@ -518,6 +518,8 @@
 @@ LUA_MAXINTEGER is the maximum value for a LUA_INTEGER.
 @@ LUA_MININTEGER is the minimum value for a LUA_INTEGER.
 @@ lua_integer2str converts an integer to a string.
+** The default uses 'luaO_int2str' (lobject.c), which writes the same
+** numeral as LUA_INTEGER_FMT without going through 'snprintf'.
 */
 
 
@@ -528,7 +530,7 @@
 #define LUAI_UACINT		LUA_INTEGER
 
 #define lua_integer2str(s,sz,n)  \
-	l_sprintf((s), sz, LUA_INTEGER_FMT, (LUAI_UACINT)(n))
+	((void)(sz), luaO_int2str((s), (LUA_INTEGER)(n)))
 
 /*
 ** use LUAI_UACINT here to avoid problems with promotions (which
@@ -589,6 +591,9 @@
 
 #endif				/* } */
 
+
+LUA_API int (luaO_int2str) (char *buff, LUA_INTEGER x);
+
 /* }================================================================== */
 
 
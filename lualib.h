@@ -38,6 +38,9 @@ LUAMOD_API int (luaopen_utf8) (lua_State *L);
 #define LUA_BITLIBNAME	"bit32"
 LUAMOD_API int (luaopen_bit32) (lua_State *L);
 
+#define LUA_SERLIBNAME	"serialize"
+LUAMOD_API int (luaopen_serialize) (lua_State *L);
+
 #define LUA_MATHLIBNAME	"math"
 LUAMOD_API int (luaopen_math) (lua_State *L);
 
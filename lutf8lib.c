@@ -24,6 +24,11 @@
 
 #define iscont(p)	((*(p) & 0xC0) == 0x80)
 
+#define isascii1(p)	(((unsigned char)*(p)) < 0x80)
+
+/* mask with the high bit of each byte of a 'size_t' set */
+#define HIGHBITS	((~(size_t)0 / 0xFF) * 0x80)
+
 
 /* from strlib */
 /* translate a relative string position: negative means back from end */
@@ -63,6 +68,23 @@ static const char *utf8_decode (const char *o, int *val) {
 }
 
 
+/*
+** Length of the run of ASCII characters at the start of 's' (with at
+** most 'len' bytes). Whole words are checked at a time while possible.
+*/
+static size_t asciirun (const char *s, size_t len) {
+  size_t i = 0;
+  while (len - i >= sizeof(size_t)) {
+    size_t w;
+    memcpy(&w, s + i, sizeof(size_t));
+    if (w & HIGHBITS) break;  /* some byte in this word is not ASCII */
+    i += sizeof(size_t);
+  }
+  while (i < len && isascii1(s + i)) i++;
+  return i;
+}
+
+
 /*
 ** utf8len(s [, i [, j]]) --> number of characters that start in the
 ** range [i,j], or nil + current position if 's' is not well formed in
@@ -79,7 +101,14 @@ static int utflen (lua_State *L) {
   luaL_argcheck(L, --posj < (lua_Integer)len, 3,
                    "final position out of string");
   while (posi <= posj) {
-    const char *s1 = utf8_decode(s + posi, NULL);
+    const char *s1;
+    if (isascii1(s + posi)) {  /* count a run of ASCII characters at once */
+      size_t k = asciirun(s + posi, (size_t)(posj - posi) + 1);
+      n += (int)k;
+      posi += k;
+      continue;
+    }
+    s1 = utf8_decode(s + posi, NULL);
     if (s1 == NULL) {  /* conversion error? */
       lua_pushnil(L);  /* return nil ... */
       lua_pushinteger(L, posi + 1);  /* ... and current position */
@@ -93,6 +122,31 @@ static int utflen (lua_State *L) {
 }
 
 
+/*
+** utf8valid(s) --> true if 's' is well formed (that is, if 'utf8.len'
+** would not fail on it)
+*/
+static int utfvalid (lua_State *L) {
+  size_t len;
+  const char *s = luaL_checklstring(L, 1, &len);
+  size_t i = 0;
+  while (i < len) {
+    if (isascii1(s + i))
+      i += asciirun(s + i, len - i);
+    else {
+      const char *s1 = utf8_decode(s + i, NULL);
+      if (s1 == NULL) {
+        lua_pushboolean(L, 0);
+        return 1;
+      }
+      i = s1 - s;
+    }
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
 /*
 ** codepoint(s, [i, [j]])  -> returns codepoints for all characters
 ** that start in the range [i,j]
@@ -183,6 +237,14 @@ static int byteoffset (lua_State *L) {
      else {
        n--;  /* do not move for 1st character */
        while (n > 0 && posi < (lua_Integer)len) {
+         if (posi + 1 < (lua_Integer)len && isascii1(s + posi + 1)) {
+           /* next characters are ASCII; skip them at once */
+           size_t k = asciirun(s + posi + 1, len - (size_t)posi - 1);
+           if ((lua_Integer)k > n) k = (size_t)n;
+           posi += k;
+           n -= k;
+           continue;
+         }
          do {  /* find beginning of next character */
            posi++;
          } while (iscont(s + posi));  /* (cannot pass final '\0') */
@@ -210,6 +272,11 @@ static int iter_aux (lua_State *L) {
   }
   if (n >= (lua_Integer)len)
     return 0;  /* no more codepoints */
+  else if (isascii1(s + n) && !iscont(s + n + 1)) {
+    lua_pushinteger(L, n + 1);  /* ASCII character */
+    lua_pushinteger(L, (unsigned char)s[n]);
+    return 2;
+  }
   else {
     int code;
     const char *next = utf8_decode(s + n, &code);
@@ -240,6 +307,7 @@ static const luaL_Reg funcs[] = {
   {"codepoint", codepoint},
   {"char", utfchar},
   {"len", utflen},
+  {"valid", utfvalid},
   {"codes", iter_codes},
   /* placeholders */
   {"charpattern", NULL},
@@ -31,6 +31,58 @@
 #include "lvm.h"
 
 
+/*
+** By default, use jump tables in the main interpreter loop on gcc
+** and compatible compilers.
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
+/*
+** Define LUAI_OPPAIRSTATS to count how many times each pair of opcodes
+** is executed in sequence. The counts are written to 'stderr' (as
+** "count first second" lines) when the program exits, to tell which
+** pairs are hot enough to deserve a fused instruction.
+*/
+#if defined(LUAI_OPPAIRSTATS)
+
+static unsigned long oppairs[NUM_OPCODES][NUM_OPCODES];
+static int lastop = -1;  /* previous executed opcode (-1 if none) */
+
+static void dumpoppairs (void) {
+  int a, b;
+  for (a = 0; a < NUM_OPCODES; a++) {
+    for (b = 0; b < NUM_OPCODES; b++) {
+      if (oppairs[a][b] > 0)
+        fprintf(stderr, "%lu\t%s\t%s\n", oppairs[a][b],
+                        luaP_opnames[a], luaP_opnames[b]);
+    }
+  }
+}
+
+static void countoppair (int op) {
+  if (lastop < 0)  /* first instruction ever? */
+    atexit(dumpoppairs);
+  else
+    oppairs[lastop][op]++;
+  lastop = op;
+}
+
+#define luai_countoppair(i)	countoppair(GET_OPCODE(i))
+
+#else
+
+#define luai_countoppair(i)	((void)0)
+
+#endif
+
+
 /* limit for table tag-method chains (to avoid loops) */
 #define MAXTAGLOOP	2000
 
@@ -754,9 +806,10 @@ void luaV_finishOp (lua_State *L) {
 
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
-  i = *(ci->u.l.savedpc++); \ // 取下一条指令
+  i = *(ci->u.l.savedpc++);  /* 取下一条指令 */ \
+  luai_countoppair(i); \
   if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) \
-    Protect(luaG_traceexec(L)); \ // 调用hook函数
+    Protect(luaG_traceexec(L));  /* 调用hook函数 */ \
   ra = RA(i); /* 得到寄存器A在数据栈中的位置。WARNING: any stack reallocation invalidates 'ra' */ \
   lua_assert(base == ci->u.l.base); \
   lua_assert(base <= L->top && L->top < L->stack + L->stacksize); \
@@ -788,6 +841,9 @@ void luaV_execute (lua_State *L) {
   LClosure *cl;
   TValue *k;
   StkId base;
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
  newframe:  /* reentry point when frame changes (call/return) */
  	// 函数调用 OP_CALL, OP_TAILCALL以及函数返回 OP_RETURN 都会回到这里，更新栈帧继续运行。
@@ -0,0 +1,108 @@
+/*
+** Standalone checker for string->float conversion
+** Compares 'lua_stringtonumber' with 'strtod' bit by bit on random
+** decimal numerals, to re-check the fast path in 'l_str2d' (lobject.c)
+** whenever it changes. Not part of the Lua library or interpreter.
+**
+** Usage: numcheck [count [seed]]
+** Exits with status 1 if any numeral converts differently.
+** See Copyright Notice in lua.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+
+/* simple deterministic generator (xorshift64*), so runs can be repeated */
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned rnd (unsigned n) {
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return (unsigned)((seed * 2685821657736338717ULL) >> 33) % n;
+}
+
+
+static int adddigits (char *p, int n) {
+  int i;
+  for (i = 0; i < n; i++)  /* zeros are frequent in real data */
+    p[i] = (rnd(5) == 0) ? '0' : (char)('0' + rnd(10));
+  return n;
+}
+
+
+/*
+** Build a random decimal numeral in 'buff': optional spaces and sign,
+** integral and fractional digits (mostly around the 15-digit limit of
+** the fast path) and an optional exponent (mostly around +-22)
+*/
+static void gennumeral (char *buff) {
+  int n = 0;
+  int nd = (int)rnd(4) == 0 ? (int)rnd(40) + 1 : (int)rnd(18) + 1;
+  int nf = (int)rnd(nd + 1);  /* digits after the dot */
+  if (rnd(8) == 0) buff[n++] = ' ';
+  if (rnd(3) == 0) buff[n++] = (rnd(4) == 0) ? '+' : '-';
+  n += adddigits(buff + n, nd - nf);
+  if (nf > 0 || rnd(4) == 0) {
+    buff[n++] = '.';
+    n += adddigits(buff + n, nf);
+  }
+  if (rnd(3) == 0)
+    n += sprintf(buff + n, "%c%d", rnd(2) ? 'e' : 'E',
+                 (int)rnd(4) == 0 ? (int)rnd(700) - 350 : (int)rnd(60) - 30);
+  if (rnd(8) == 0) buff[n++] = ' ';
+  buff[n] = '\0';
+}
+
+
+static int check (lua_State *L, const char *s, long *nfloats) {
+  double d, r;
+  lua_settop(L, 0);
+  if (lua_stringtonumber(L, s) == 0 || lua_isinteger(L, -1))
+    return 1;  /* not a float numeral; nothing to compare */
+  (*nfloats)++;
+  d = (double)lua_tonumber(L, -1);
+  r = strtod(s, NULL);
+  if (memcmp(&d, &r, sizeof(d)) != 0) {
+    printf("mismatch: \"%s\": %.17g (lua) vs %.17g (strtod)\n", s, d, r);
+    return 0;
+  }
+  return 1;
+}
+
+
+int main (int argc, char **argv) {
+  static const char *const fixed[] = {
+    "0.0", "-0.0", "1e22", "1e23", "123456789012345e22",
+    "1234567890123456e-22", "9007199254740993.0", "0.1", "0.3",
+    "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308",
+    ".5", "5.", "  12.5  ", "1e-22", "0.000000000000000000000001",
+    NULL
+  };
+  long count = (argc > 1) ? atol(argv[1]) : 1000000;
+  long i, nfloats = 0, bad = 0;
+  lua_State *L = luaL_newstate();
+  if (L == NULL) {
+    fprintf(stderr, "cannot create state: not enough memory\n");
+    return EXIT_FAILURE;
+  }
+  if (argc > 2) seed ^= strtoull(argv[2], NULL, 10);
+  if (seed == 0) seed = 1;  /* xorshift needs a nonzero state */
+  for (i = 0; fixed[i] != NULL; i++)
+    bad += !check(L, fixed[i], &nfloats);
+  for (i = 0; i < count; i++) {
+    char buff[128];
+    gennumeral(buff);
+    bad += !check(L, buff, &nfloats);
+  }
+  lua_close(L);
+  printf("%ld numerals, %ld floats compared, %ld mismatches\n",
+         count, nfloats, bad);
+  return (bad == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+